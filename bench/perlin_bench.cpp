@@ -0,0 +1,61 @@
+// Compares the lane-parallel perlin::turb against the scalar reference: time per call and
+// the largest difference over a fixed set of points.
+//
+// usage: perlin_bench [points] [repeats]
+
+#include "headers.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "noise/perlin.h"
+
+template <class F>
+double time_ns_per_call(const std::vector<point3> &points, int repeats, F turb, double &checksum)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    for (int r = 0; r < repeats; r++)
+    {
+        for (const auto &p : points)
+        {
+            checksum += turb(p);
+        }
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return elapsed.count() / (double(points.size()) * repeats);
+}
+
+int main(int argc, const char *argv[])
+{
+    int count = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int repeats = argc > 2 ? std::atoi(argv[2]) : 10;
+
+    perlin noise;
+    std::vector<point3> points;
+    points.reserve(count);
+    for (int i = 0; i < count; i++)
+    {
+        // Mostly shading-scale coordinates, with some far away points like a ground plane.
+        auto range = i % 16 == 0 ? 1000.0 : 10.0;
+        points.push_back(point3::random(-range, range));
+    }
+
+    double max_error = 0;
+    for (const auto &p : points)
+    {
+        max_error = fmax(max_error, fabs(noise.turb(p) - noise.turb_reference(p)));
+    }
+
+    double checksum = 0;
+    auto reference = time_ns_per_call(points, repeats, [&](const point3 &p)
+                                      { return noise.turb_reference(p); }, checksum);
+    auto lanes = time_ns_per_call(points, repeats, [&](const point3 &p)
+                                  { return noise.turb(p); }, checksum);
+
+    std::cout << "points " << count << ", repeats " << repeats << "\n"
+              << "turb_reference " << reference << " ns/call\n"
+              << "turb           " << lanes << " ns/call (" << reference / lanes << "x)\n"
+              << "max abs error  " << max_error << "\n"
+              << "checksum       " << checksum << "\n";
+    return 0;
+}
@@ -4,20 +4,21 @@
 
 class hittable;
 
-class aabb
+template <class T>
+class aabb_t
 {
 public:
-    point3 minimum;
-    point3 maximum;
+    vec3_t<T> minimum;
+    vec3_t<T> maximum;
 
 public:
-    aabb() {}
-    aabb(const point3 &a, const point3 &b) : minimum(a), maximum(b) {}
+    aabb_t() {}
+    aabb_t(const vec3_t<T> &a, const vec3_t<T> &b) : minimum(a), maximum(b) {}
 
-    point3 min() const { return minimum; }
-    point3 max() const { return maximum; }
+    vec3_t<T> min() const { return minimum; }
+    vec3_t<T> max() const { return maximum; }
 
-    bool hit(const ray &r, double t_min, double t_max) const
+    bool hit(const ray_t<T> &r, T t_min, T t_max) const
     {
         for (int i = 0; i < 3; i++)
         {
@@ -40,15 +41,18 @@ public:
     }
 };
 
-aabb surrounding_box(aabb box0, aabb box1)
+using aabb = aabb_t<real>;
+
+template <class T>
+aabb_t<T> surrounding_box(aabb_t<T> box0, aabb_t<T> box1)
 {
-    point3 small(fmin(box0.min().x(), box1.min().x()),
-                 fmin(box0.min().y(), box1.min().y()),
-                 fmin(box0.min().z(), box1.min().z()));
+    vec3_t<T> small(fmin(box0.min().x(), box1.min().x()),
+                    fmin(box0.min().y(), box1.min().y()),
+                    fmin(box0.min().z(), box1.min().z()));
 
-    point3 big(fmax(box0.max().x(), box1.max().x()),
-               fmax(box0.max().y(), box1.max().y()),
-               fmax(box0.max().z(), box1.max().z()));
+    vec3_t<T> big(fmax(box0.max().x(), box1.max().x()),
+                  fmax(box0.max().y(), box1.max().y()),
+                  fmax(box0.max().z(), box1.max().z()));
 
-    return aabb(small, big);
+    return aabb_t<T>(small, big);
 }
\ No newline at end of file
@@ -21,6 +21,15 @@ public:
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override;
+
+    virtual void collect_materials(std::vector<material *> &out) const override
+    {
+        left->collect_materials(out);
+        if (right != left)
+        {
+            right->collect_materials(out);
+        }
+    }
 };
 
 bool bvh_node::bounding_box(double time0, double time1, aabb &output_box) const
@@ -73,8 +82,8 @@ bvh_node::bvh_node(const std::vector<shared_ptr<hittable>> &src_objects, size_t
         std::sort(objects.begin() + start, objects.begin() + end, comparator);
 
         auto mid = start + object_span / 2;
-        left = make_shared<bvh_node>(objects, start, mid, time0, time1);
-        right = make_shared<bvh_node>(objects, mid, end, time0, time1);
+        left = make_scene_object<bvh_node>(objects, start, mid, time0, time1);
+        right = make_scene_object<bvh_node>(objects, mid, end, time0, time1);
     }
 
     aabb box_left, box_right;
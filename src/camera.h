@@ -2,19 +2,20 @@
 
 #include "headers.h"
 
-class camera
+template <class T>
+class camera_t
 {
 public:
-    point3 origin;
-    point3 lower_left_corner;
-    vec3 horizontal;
-    vec3 vertical;
-    vec3 u, v, w;
-    double lens_radius;
-    double time0, time1; // shutter open/close time
+    vec3_t<T> origin;
+    vec3_t<T> lower_left_corner;
+    vec3_t<T> horizontal;
+    vec3_t<T> vertical;
+    vec3_t<T> u, v, w;
+    T lens_radius;
+    T time0, time1; // shutter open/close time
 
 public:
-    camera(point3 lookfrom, point3 lookat, vec3 vup, double vfov, double aspect_ratio, double aperture, double focus_dist, double _time0 = 0, double _time1 = 0)
+    camera_t(vec3_t<T> lookfrom, vec3_t<T> lookat, vec3_t<T> vup, double vfov, double aspect_ratio, double aperture, double focus_dist, double _time0 = 0, double _time1 = 0)
     {
         auto theta = degrees_to_radians(vfov);
         auto h = tan(theta / 2);
@@ -36,10 +37,25 @@ public:
         time1 = _time1;
     }
 
-    ray get_ray(double s, double t) const
+    ray_t<T> get_ray(double s, double t) const
     {
-        vec3 rd = lens_radius * random_in_unit_disk();
-        vec3 offset = u * rd.x() + v * rd.y();
-        return ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset, random_double(time0, time1));
+        vec3_t<T> rd = lens_radius * random_in_unit_disk();
+        vec3_t<T> offset = u * rd.x() + v * rd.y();
+        return ray_t<T>(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset, random_double(time0, time1));
     }
-};
\ No newline at end of file
+
+    // Ray through (s, t) with differentials through (s + ds, t) and (s, t + dt). All three
+    // share the lens sample.
+    ray_t<T> get_ray(double s, double t, double ds, double dt) const
+    {
+        auto r = get_ray(s, t);
+        r.has_differentials = true;
+        r.rx_origin = r.origin();
+        r.ry_origin = r.origin();
+        r.rx_direction = r.direction() + ds * horizontal;
+        r.ry_direction = r.direction() + dt * vertical;
+        return r;
+    }
+};
+
+using camera = camera_t<real>;
\ No newline at end of file
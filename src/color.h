@@ -2,9 +2,14 @@
 
 #include "headers.h"
 #include "vec3.h"
-#include "rgb.h"
 #include <iostream>
 
+// Rec. 709 relative luminance of a linear color.
+inline double luminance(const color &c)
+{
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
+
 void write_color(std::ostream &out, color pixel_color, int samples_per_pixel)
 {
     auto r = pixel_color.x();
@@ -21,20 +26,3 @@ void write_color(std::ostream &out, color pixel_color, int samples_per_pixel)
         << static_cast<int>(256 * clamp(g, 0, 0.999)) << ' '
         << static_cast<int>(256 * clamp(b, 0, 0.999)) << '\n';
 }
-
-void write_color(std::vector<rgb> &out, color pixel_color, int samples_per_pixel)
-{
-    auto r = pixel_color.x();
-    auto g = pixel_color.y();
-    auto b = pixel_color.z();
-
-    // Divide the color by the number of samples and gamma-correct for gamma=2.0.
-    auto scale = 1.0 / samples_per_pixel;
-    r = sqrt(scale * r);
-    g = sqrt(scale * g);
-    b = sqrt(scale * b);
-
-    out.push_back(rgb(static_cast<int>(256 * clamp(r, 0, 0.999)),
-                      static_cast<int>(256 * clamp(g, 0, 0.999)),
-                      static_cast<int>(256 * clamp(b, 0, 0.999))));
-}
\ No newline at end of file
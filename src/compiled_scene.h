@@ -0,0 +1,678 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <typeinfo>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "headers.h"
+#include "aabb.h"
+#include "bvh_node.h"
+#include "geometry/hittable.h"
+#include "geometry/hittable_list.h"
+#include "geometry/sphere.h"
+#include "geometry/moving_sphere.h"
+#include "geometry/aarect.h"
+#include "geometry/box.h"
+#include "material/material.h"
+#include "texture/texture.h"
+
+// Render-time form of a scene. The hittable classes stay the scene-building API; compiling
+// flattens their hierarchy, copies the primitives it knows into per-type contiguous arrays
+// and builds one BVH whose leaves reference typed ranges of those arrays. Traversal calls the
+// per-type kernels directly, so only primitives without a kernel (media, instances, sphere
+// sets, ...) still go through hittable::hit.
+class compiled_scene : public hittable
+{
+public:
+    struct sphere_prim
+    {
+        real center[3];
+        real motion[3]; // center displacement per unit time, zero for static spheres
+        real time0;
+        real radius;
+        uint32_t mat;
+    };
+
+    struct rect_prim
+    {
+        real a0, a1, b0, b1, k; // extent on the two in-plane axes, offset on the normal axis
+        uint8_t axis;             // normal axis: 0 for yz_rect, 1 for xz_rect, 2 for xy_rect
+        uint32_t mat;
+    };
+
+    struct leaf_ranges
+    {
+        uint32_t sphere_begin, sphere_count;
+        uint32_t rect_begin, rect_count;
+        uint32_t other_begin, other_count;
+    };
+
+    struct node
+    {
+        real min[3];
+        real max[3];
+        uint32_t offset; // leaf: index into leaves; interior: right child (left child is next)
+        uint8_t is_leaf;
+        uint8_t axis;
+    };
+
+    std::vector<sphere_prim> spheres;
+    std::vector<rect_prim> rects;
+    std::vector<shared_ptr<hittable>> others;
+    std::vector<shared_ptr<material>> materials; // immutable table indexed by the primitives' mat
+    std::vector<leaf_ranges> leaves;
+    std::vector<node> nodes;
+    aabb bbox;
+    double shutter_open = 0, shutter_close = 0;
+
+public:
+    compiled_scene() {}
+    compiled_scene(const hittable &world, double time0, double time1);
+
+    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
+
+    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    {
+        output_box = bbox;
+        return !nodes.empty();
+    }
+
+    // Memory of the typed primitive arrays, including heap owned by kernel-less primitives.
+    size_t primitive_bytes() const;
+    size_t bvh_bytes() const;
+    size_t material_table_bytes() const;
+
+    // Index of `m` in the material table, -1 for materials only used by kernel-less primitives.
+    int material_id(const material *m) const
+    {
+        auto found = material_lookup.find(m);
+        return found == material_lookup.end() ? -1 : static_cast<int>(found->second);
+    }
+
+    // The material table followed by the materials only kernel-less primitives refer to, each
+    // listed once.
+    std::vector<material *> all_materials() const;
+
+    // Every texture reachable from all_materials(), each listed once.
+    std::vector<const texture *> textures() const;
+
+    // Compiles the texture graphs of all_materials() into texture programs.
+    void compile_textures();
+
+    // A primitive's hit_record::object_id and bounds.
+    struct primitive_box
+    {
+        int object_id;
+        aabb box;
+    };
+
+    // Bounds of every sphere and rectangle using each material, indexed like `materials`; empty
+    // for materials only referenced by kernel-less primitives.
+    void primitive_bounds(std::vector<std::vector<primitive_box>> &bounds) const;
+
+private:
+    enum class prim_kind : uint8_t
+    {
+        sphere,
+        rect,
+        other
+    };
+
+    struct prim_ref
+    {
+        prim_kind kind;
+        uint32_t index;
+        aabb box;
+        real centroid[3];
+    };
+
+    static const int MAX_LEAF_SIZE = 4;
+
+    std::unordered_map<const material *, uint32_t> material_lookup;
+
+    uint32_t material_index(const shared_ptr<material> &m);
+    static rect_prim make_rect(real a0, real a1, real b0, real b1, real k, uint8_t axis, uint32_t mat)
+    {
+        return {a0, a1, b0, b1, k, axis, mat};
+    }
+    void flatten(const hittable &object, const shared_ptr<hittable> &owner, double time0, double time1,
+                 std::vector<sphere_prim> &all_spheres, std::vector<rect_prim> &all_rects,
+                 std::vector<shared_ptr<hittable>> &all_others, std::vector<prim_ref> &refs);
+    uint32_t build_node(std::vector<prim_ref> &refs, size_t start, size_t end,
+                        const std::vector<sphere_prim> &all_spheres, const std::vector<rect_prim> &all_rects,
+                        const std::vector<shared_ptr<hittable>> &all_others);
+
+    // Traversal kernels only find the parametric distance; the surface attributes of the
+    // closest hit are filled in once by surface_interaction() after traversal.
+    static bool hit_sphere(const sphere_prim &s, const ray &r, double t_min, double t_max, double &t);
+    static bool hit_rect(const rect_prim &q, const ray &r, double t_min, double t_max, double &t);
+
+    void surface_interaction(prim_kind kind, uint32_t index, const ray &r, double t, hit_record &rec) const;
+};
+
+compiled_scene::compiled_scene(const hittable &world, double time0, double time1) : shutter_open(time0), shutter_close(time1)
+{
+    std::vector<sphere_prim> all_spheres;
+    std::vector<rect_prim> all_rects;
+    std::vector<shared_ptr<hittable>> all_others;
+    std::vector<prim_ref> refs;
+
+    flatten(world, nullptr, time0, time1, all_spheres, all_rects, all_others, refs);
+
+    if (refs.empty())
+    {
+        return;
+    }
+
+    nodes.reserve(2 * refs.size());
+    build_node(refs, 0, refs.size(), all_spheres, all_rects, all_others);
+
+    const auto &root = nodes[0];
+    bbox = aabb(point3(root.min[0], root.min[1], root.min[2]), point3(root.max[0], root.max[1], root.max[2]));
+}
+
+size_t compiled_scene::primitive_bytes() const
+{
+    size_t bytes = spheres.capacity() * sizeof(sphere_prim) +
+                   rects.capacity() * sizeof(rect_prim) +
+                   others.capacity() * sizeof(shared_ptr<hittable>);
+    for (const auto &other : others)
+    {
+        bytes += other->heap_bytes();
+    }
+    return bytes;
+}
+
+std::vector<material *> compiled_scene::all_materials() const
+{
+    std::vector<material *> found;
+    std::unordered_set<const material *> listed;
+    for (const auto &m : materials)
+    {
+        found.push_back(m.get());
+        listed.insert(m.get());
+    }
+    std::vector<material *> wrapped;
+    for (const auto &other : others)
+    {
+        other->collect_materials(wrapped);
+    }
+    for (auto m : wrapped)
+    {
+        if (m != nullptr && listed.insert(m).second)
+        {
+            found.push_back(m);
+        }
+    }
+    return found;
+}
+
+void compiled_scene::compile_textures()
+{
+    for (auto m : all_materials())
+    {
+        m->compile_textures();
+    }
+}
+
+void compiled_scene::primitive_bounds(std::vector<std::vector<primitive_box>> &bounds) const
+{
+    bounds.assign(materials.size(), {});
+    int object_id = 0;
+    auto include = [&](uint32_t mat, const aabb &box)
+    {
+        bounds[mat].push_back({object_id++, box});
+    };
+
+    // Spheres then rectangles, numbered like hit() numbers object ids.
+    for (const auto &s : spheres)
+    {
+        // Moving spheres cover their path over the shutter interval.
+        vec3 r(s.radius, s.radius, s.radius);
+        aabb box;
+        for (auto time : {shutter_open, shutter_close})
+        {
+            auto dt = real(time - s.time0);
+            point3 c(s.center[0] + dt * s.motion[0], s.center[1] + dt * s.motion[1], s.center[2] + dt * s.motion[2]);
+            box = time == shutter_open ? aabb(c - r, c + r) : surrounding_box(box, aabb(c - r, c + r));
+        }
+        include(s.mat, box);
+    }
+    for (const auto &q : rects)
+    {
+        const int axis_a = q.axis == 0 ? 1 : 0;
+        const int axis_b = q.axis == 2 ? 1 : 2;
+        point3 lo, hi;
+        lo[axis_a] = q.a0;
+        hi[axis_a] = q.a1;
+        lo[axis_b] = q.b0;
+        hi[axis_b] = q.b1;
+        lo[q.axis] = q.k;
+        hi[q.axis] = q.k;
+        include(q.mat, aabb(lo, hi));
+    }
+}
+
+size_t compiled_scene::bvh_bytes() const
+{
+    return nodes.capacity() * sizeof(node) + leaves.capacity() * sizeof(leaf_ranges);
+}
+
+size_t compiled_scene::material_table_bytes() const
+{
+    return materials.capacity() * sizeof(shared_ptr<material>);
+}
+
+std::vector<const texture *> compiled_scene::textures() const
+{
+    std::vector<const texture *> pending;
+    for (auto m : all_materials())
+    {
+        m->collect_textures(pending);
+    }
+
+    std::vector<const texture *> found;
+    while (!pending.empty())
+    {
+        auto t = pending.back();
+        pending.pop_back();
+        if (std::find(found.begin(), found.end(), t) == found.end())
+        {
+            found.push_back(t);
+            t->collect_textures(pending);
+        }
+    }
+    return found;
+}
+
+uint32_t compiled_scene::material_index(const shared_ptr<material> &m)
+{
+    auto found = material_lookup.find(m.get());
+    if (found != material_lookup.end())
+    {
+        return found->second;
+    }
+
+    auto index = static_cast<uint32_t>(materials.size());
+    materials.push_back(m);
+    material_lookup[m.get()] = index;
+    return index;
+}
+
+void compiled_scene::flatten(const hittable &object, const shared_ptr<hittable> &owner, double time0, double time1,
+                             std::vector<sphere_prim> &all_spheres, std::vector<rect_prim> &all_rects,
+                             std::vector<shared_ptr<hittable>> &all_others, std::vector<prim_ref> &refs)
+{
+    auto &type = typeid(object);
+    prim_ref ref;
+
+    if (type == typeid(bvh_node))
+    {
+        auto &node = static_cast<const bvh_node &>(object);
+        flatten(*node.left, node.left, time0, time1, all_spheres, all_rects, all_others, refs);
+        if (node.right != node.left)
+        {
+            flatten(*node.right, node.right, time0, time1, all_spheres, all_rects, all_others, refs);
+        }
+        return;
+    }
+    else if (type == typeid(hittable_list))
+    {
+        for (const auto &child : static_cast<const hittable_list &>(object).objects)
+        {
+            flatten(*child, child, time0, time1, all_spheres, all_rects, all_others, refs);
+        }
+        return;
+    }
+    else if (type == typeid(box))
+    {
+        flatten(static_cast<const box &>(object).sides, nullptr, time0, time1, all_spheres, all_rects, all_others, refs);
+        return;
+    }
+    else if (type == typeid(sphere) || type == typeid(moving_sphere))
+    {
+        auto &s = static_cast<const sphere &>(object);
+        sphere_prim prim;
+        prim.center[0] = s.center0.x();
+        prim.center[1] = s.center0.y();
+        prim.center[2] = s.center0.z();
+        prim.motion[0] = prim.motion[1] = prim.motion[2] = 0;
+        prim.time0 = 0;
+        prim.radius = s.radius;
+        prim.mat = material_index(s.mat_ptr);
+
+        if (type == typeid(moving_sphere))
+        {
+            auto &m = static_cast<const moving_sphere &>(object);
+            auto motion = (m.center1 - m.center0) / (m.time1 - m.time0);
+            prim.motion[0] = motion.x();
+            prim.motion[1] = motion.y();
+            prim.motion[2] = motion.z();
+            prim.time0 = m.time0;
+        }
+
+        ref.kind = prim_kind::sphere;
+        ref.index = static_cast<uint32_t>(all_spheres.size());
+        all_spheres.push_back(prim);
+    }
+    else if (type == typeid(xy_rect))
+    {
+        auto &q = static_cast<const xy_rect &>(object);
+        all_rects.push_back(make_rect(q.x0, q.x1, q.y0, q.y1, q.k, 2, material_index(q.mat)));
+        ref.kind = prim_kind::rect;
+        ref.index = static_cast<uint32_t>(all_rects.size() - 1);
+    }
+    else if (type == typeid(xz_rect))
+    {
+        auto &q = static_cast<const xz_rect &>(object);
+        all_rects.push_back(make_rect(q.x0, q.x1, q.z0, q.z1, q.k, 1, material_index(q.mp)));
+        ref.kind = prim_kind::rect;
+        ref.index = static_cast<uint32_t>(all_rects.size() - 1);
+    }
+    else if (type == typeid(yz_rect))
+    {
+        auto &q = static_cast<const yz_rect &>(object);
+        all_rects.push_back(make_rect(q.y0, q.y1, q.z0, q.z1, q.k, 0, material_index(q.mp)));
+        ref.kind = prim_kind::rect;
+        ref.index = static_cast<uint32_t>(all_rects.size() - 1);
+    }
+    else
+    {
+        if (!owner)
+        {
+            std::cerr << "Primitive without owner in compiled_scene.\n";
+            return;
+        }
+        ref.kind = prim_kind::other;
+        ref.index = static_cast<uint32_t>(all_others.size());
+        all_others.push_back(owner);
+    }
+
+    if (!object.bounding_box(time0, time1, ref.box))
+    {
+        std::cerr << "No bounding box in compiled_scene constructor.\n";
+    }
+    for (int a = 0; a < 3; a++)
+    {
+        ref.centroid[a] = 0.5 * (ref.box.min()[a] + ref.box.max()[a]);
+    }
+    refs.push_back(ref);
+}
+
+uint32_t compiled_scene::build_node(std::vector<prim_ref> &refs, size_t start, size_t end,
+                                    const std::vector<sphere_prim> &all_spheres, const std::vector<rect_prim> &all_rects,
+                                    const std::vector<shared_ptr<hittable>> &all_others)
+{
+    auto index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(node());
+
+    node n;
+    real centroid_min[3];
+    real centroid_max[3];
+    for (int a = 0; a < 3; a++)
+    {
+        n.min[a] = centroid_min[a] = infinity;
+        n.max[a] = centroid_max[a] = -infinity;
+    }
+    for (size_t i = start; i < end; i++)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            n.min[a] = fmin(n.min[a], refs[i].box.min()[a]);
+            n.max[a] = fmax(n.max[a], refs[i].box.max()[a]);
+            centroid_min[a] = fmin(centroid_min[a], refs[i].centroid[a]);
+            centroid_max[a] = fmax(centroid_max[a], refs[i].centroid[a]);
+        }
+    }
+
+    auto span = end - start;
+    if (span <= MAX_LEAF_SIZE)
+    {
+        // Emit the leaf's primitives into the final arrays, grouped by type, so the leaf
+        // covers one contiguous range per type.
+        leaf_ranges leaf;
+        leaf.sphere_begin = static_cast<uint32_t>(spheres.size());
+        leaf.rect_begin = static_cast<uint32_t>(rects.size());
+        leaf.other_begin = static_cast<uint32_t>(others.size());
+        for (size_t i = start; i < end; i++)
+        {
+            switch (refs[i].kind)
+            {
+            case prim_kind::sphere:
+                spheres.push_back(all_spheres[refs[i].index]);
+                break;
+            case prim_kind::rect:
+                rects.push_back(all_rects[refs[i].index]);
+                break;
+            case prim_kind::other:
+                others.push_back(all_others[refs[i].index]);
+                break;
+            }
+        }
+        leaf.sphere_count = static_cast<uint32_t>(spheres.size()) - leaf.sphere_begin;
+        leaf.rect_count = static_cast<uint32_t>(rects.size()) - leaf.rect_begin;
+        leaf.other_count = static_cast<uint32_t>(others.size()) - leaf.other_begin;
+
+        n.offset = static_cast<uint32_t>(leaves.size());
+        n.is_leaf = 1;
+        n.axis = 0;
+        leaves.push_back(leaf);
+        nodes[index] = n;
+        return index;
+    }
+
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+    {
+        if (centroid_max[a] - centroid_min[a] > centroid_max[axis] - centroid_min[axis])
+        {
+            axis = a;
+        }
+    }
+
+    auto mid = start + span / 2;
+    std::nth_element(refs.begin() + start, refs.begin() + mid, refs.begin() + end,
+                     [axis](const prim_ref &a, const prim_ref &b)
+                     { return a.centroid[axis] < b.centroid[axis]; });
+
+    n.is_leaf = 0;
+    n.axis = static_cast<uint8_t>(axis);
+    build_node(refs, start, mid, all_spheres, all_rects, all_others);
+    n.offset = build_node(refs, mid, end, all_spheres, all_rects, all_others);
+    nodes[index] = n;
+    return index;
+}
+
+inline bool compiled_scene::hit_sphere(const sphere_prim &s, const ray &r, double t_min, double t_max, double &t)
+{
+    auto dt = r.time() - s.time0;
+    auto center = point3(s.center[0] + dt * s.motion[0], s.center[1] + dt * s.motion[1], s.center[2] + dt * s.motion[2]);
+
+    vec3 oc = r.origin() - center;
+    auto a = r.direction().length_squared();
+    auto half_b = dot(r.direction(), oc);
+    auto c = oc.length_squared() - s.radius * s.radius;
+
+    auto discriminant = half_b * half_b - a * c;
+    if (discriminant < 0)
+    {
+        return false;
+    }
+
+    auto sqrtd = sqrt(discriminant);
+
+    auto root = (-half_b - sqrtd) / a;
+    if (root < t_min || root > t_max)
+    {
+        root = (-half_b + sqrtd) / a;
+        if (root < t_min || root > t_max)
+        {
+            return false;
+        }
+    }
+
+    t = root;
+    return true;
+}
+
+inline bool compiled_scene::hit_rect(const rect_prim &q, const ray &r, double t_min, double t_max, double &t)
+{
+    // In-plane axes in the order the rect classes use for u and v.
+    const int axis_a = q.axis == 0 ? 1 : 0;
+    const int axis_b = q.axis == 2 ? 1 : 2;
+
+    t = (q.k - r.origin()[q.axis]) / r.direction()[q.axis];
+    if (t < t_min || t > t_max)
+    {
+        return false;
+    }
+
+    auto a = r.origin()[axis_a] + t * r.direction()[axis_a];
+    auto b = r.origin()[axis_b] + t * r.direction()[axis_b];
+    return a >= q.a0 && a <= q.a1 && b >= q.b0 && b <= q.b1;
+}
+
+void compiled_scene::surface_interaction(prim_kind kind, uint32_t index, const ray &r, double t, hit_record &rec) const
+{
+    rec.t = t;
+    rec.p = r.at(t);
+
+    if (kind == prim_kind::sphere)
+    {
+        const auto &s = spheres[index];
+        auto dt = r.time() - s.time0;
+        auto center = point3(s.center[0] + dt * s.motion[0], s.center[1] + dt * s.motion[1], s.center[2] + dt * s.motion[2]);
+        vec3 outward_normal = (rec.p - center) / s.radius;
+        rec.set_face_normal(r, outward_normal);
+        sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+        rec.mat_ptr = materials[s.mat].get();
+        rec.set_differentials(r, [&](const point3 &p, double &u, double &v)
+                              { sphere::get_sphere_uv(unit_vector(p - center), u, v); }, true);
+    }
+    else
+    {
+        const auto &q = rects[index];
+        const int axis_a = q.axis == 0 ? 1 : 0;
+        const int axis_b = q.axis == 2 ? 1 : 2;
+        rec.u = (rec.p[axis_a] - q.a0) / (q.a1 - q.a0);
+        rec.v = (rec.p[axis_b] - q.b0) / (q.b1 - q.b0);
+        vec3 outward_normal;
+        outward_normal[q.axis] = 1;
+        rec.set_face_normal(r, outward_normal);
+        rec.mat_ptr = materials[q.mat].get();
+        rec.set_differentials(r, [&](const point3 &p, double &u, double &v)
+                              {
+                                  u = (p[axis_a] - q.a0) / (q.a1 - q.a0);
+                                  v = (p[axis_b] - q.b0) / (q.b1 - q.b0);
+                              });
+    }
+}
+
+bool compiled_scene::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    real origin[3] = {r.origin().x(), r.origin().y(), r.origin().z()};
+    real inv_dir[3] = {1 / r.direction().x(), 1 / r.direction().y(), 1 / r.direction().z()};
+
+    uint32_t stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    bool hit_anything = false;
+    prim_kind hit_kind = prim_kind::other;
+    uint32_t hit_index = 0;
+
+    while (stack_size > 0)
+    {
+        auto index = stack[--stack_size];
+        const auto &n = nodes[index];
+
+        real t0 = t_min;
+        real t1 = t_max;
+        for (int a = 0; a < 3; a++)
+        {
+            auto t_near = (n.min[a] - origin[a]) * inv_dir[a];
+            auto t_far = (n.max[a] - origin[a]) * inv_dir[a];
+            if (inv_dir[a] < 0)
+            {
+                std::swap(t_near, t_far);
+            }
+            t0 = t_near > t0 ? t_near : t0;
+            t1 = t_far < t1 ? t_far : t1;
+        }
+        if (t1 <= t0)
+        {
+            continue;
+        }
+
+        if (n.is_leaf)
+        {
+            const auto &leaf = leaves[n.offset];
+            double t;
+            for (uint32_t i = leaf.sphere_begin; i < leaf.sphere_begin + leaf.sphere_count; i++)
+            {
+                if (hit_sphere(spheres[i], r, t_min, t_max, t))
+                {
+                    hit_anything = true;
+                    hit_kind = prim_kind::sphere;
+                    hit_index = i;
+                    t_max = t;
+                }
+            }
+            for (uint32_t i = leaf.rect_begin; i < leaf.rect_begin + leaf.rect_count; i++)
+            {
+                if (hit_rect(rects[i], r, t_min, t_max, t))
+                {
+                    hit_anything = true;
+                    hit_kind = prim_kind::rect;
+                    hit_index = i;
+                    t_max = t;
+                }
+            }
+            // Primitives without a kernel fill the whole record themselves.
+            for (uint32_t i = leaf.other_begin; i < leaf.other_begin + leaf.other_count; i++)
+            {
+                if (others[i]->hit(r, t_min, t_max, rec))
+                {
+                    hit_anything = true;
+                    hit_kind = prim_kind::other;
+                    hit_index = i;
+                    t_max = rec.t;
+                }
+            }
+            continue;
+        }
+
+        auto left = index + 1;
+        auto right = n.offset;
+        if (inv_dir[n.axis] < 0)
+        {
+            stack[stack_size++] = left;
+            stack[stack_size++] = right;
+        }
+        else
+        {
+            stack[stack_size++] = right;
+            stack[stack_size++] = left;
+        }
+    }
+
+    if (hit_anything && hit_kind != prim_kind::other)
+    {
+        surface_interaction(hit_kind, hit_index, r, t_max, rec);
+    }
+    if (hit_anything)
+    {
+        rec.object_id = static_cast<int>(hit_kind == prim_kind::sphere ? hit_index
+                                         : hit_kind == prim_kind::rect ? spheres.size() + hit_index
+                                                                       : spheres.size() + rects.size() + hit_index);
+    }
+
+    return hit_anything;
+}
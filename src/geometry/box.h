@@ -11,6 +11,7 @@ class box : public hittable
 public:
     point3 box_min;
     point3 box_max;
+    shared_ptr<material> mat;
     hittable_list sides;
 
 public:
@@ -24,21 +25,32 @@ public:
         output_box = aabb(box_min, box_max);
         return true;
     }
+
+    virtual size_t heap_bytes() const override
+    {
+        return sides.heap_bytes();
+    }
+
+    virtual void collect_materials(std::vector<material *> &out) const override
+    {
+        sides.collect_materials(out);
+    }
 };
 
 box::box(const point3 &p0, const point3 &p1, shared_ptr<material> mat)
 {
     box_min = p0;
     box_max = p1;
+    this->mat = mat;
 
-    sides.add(make_shared<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), mat));
-    sides.add(make_shared<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), mat));
+    sides.add(make_scene_object<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), mat));
+    sides.add(make_scene_object<xy_rect>(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), mat));
 
-    sides.add(make_shared<xz_rect>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), mat));
-    sides.add(make_shared<xz_rect>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), mat));
+    sides.add(make_scene_object<xz_rect>(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), mat));
+    sides.add(make_scene_object<xz_rect>(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), mat));
 
-    sides.add(make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), mat));
-    sides.add(make_shared<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), mat));
+    sides.add(make_scene_object<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), mat));
+    sides.add(make_scene_object<yz_rect>(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), mat));
 }
 
 bool box::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
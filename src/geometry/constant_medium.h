@@ -15,11 +15,11 @@ public:
 
 public:
     constant_medium(shared_ptr<hittable> b, double d, shared_ptr<texture> tex)
-        : boundary(b), neg_inv_density(-1 / d), phase_function(make_shared<isotropic>(tex))
+        : boundary(b), neg_inv_density(-1 / d), phase_function(make_scene_object<isotropic>(tex))
     {
     }
     constant_medium(shared_ptr<hittable> b, double d, color c)
-        : boundary(b), neg_inv_density(-1 / d), phase_function(make_shared<isotropic>(c))
+        : boundary(b), neg_inv_density(-1 / d), phase_function(make_scene_object<isotropic>(c))
     {
     }
 
@@ -29,6 +29,13 @@ public:
     {
         return boundary->bounding_box(time0, time1, output_box);
     }
+
+    virtual size_t heap_bytes() const override { return boundary->heap_bytes(); }
+
+    virtual void collect_materials(std::vector<material *> &out) const override
+    {
+        out.push_back(phase_function.get());
+    }
 };
 
 bool
@@ -78,7 +85,8 @@ constant_medium::hit(const ray &r, double t_min, double t_max, hit_record &rec)
     rec.p = r.at(rec.t);
     rec.normal = vec3(1, 0, 0); // arbitrary
     rec.front_face = true;      // also arbitrary
-    rec.mat_ptr = phase_function;
+    rec.mat_ptr = phase_function.get();
+    rec.has_differentials = false;
 
     return true;
 }
\ No newline at end of file
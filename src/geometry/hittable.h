@@ -1,7 +1,9 @@
 #pragma once
 
+#include <vector>
 #include "ray.h"
 #include "aabb.h"
+#include "texture/texture.h"
 
 class material;
 
@@ -9,23 +11,94 @@ struct hit_record
 {
     point3 p;
     vec3 normal;
-    shared_ptr<material> mat_ptr;
+    // Non-owning: materials are owned by the scene and outlive every hit_record, so the hot
+    // path never touches a reference count.
+    const material *mat_ptr = nullptr;
     double t;
     double u;
     double v;
     bool front_face;
+    // Index of the primitive hit within the compiled scene; -1 for hits outside of one.
+    int object_id = -1;
+
+    // Offsets of p and (u, v) towards the neighbouring pixels, from the ray's differentials.
+    bool has_differentials = false;
+    vec3 dpdx, dpdy;
+    double dudx, dvdx, dudy, dvdy;
 
     inline void set_face_normal(const ray &r, const vec3 &outward_normal)
     {
         front_face = dot(r.direction(), outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    // Intersects the differential rays of `r` with the tangent plane at p and maps the two
+    // points to (u, v) with `uv_at(point, u, v)`. Needs p, normal, u and v to be set already.
+    // `wrap_u` treats u as periodic, as on spheres.
+    template <class UV>
+    void set_differentials(const ray &r, UV uv_at, bool wrap_u = false);
+
+    texture_footprint footprint() const;
 };
 
+template <class UV>
+void hit_record::set_differentials(const ray &r, UV uv_at, bool wrap_u)
+{
+    has_differentials = false;
+    if (!r.has_differentials)
+    {
+        return;
+    }
+
+    auto nx = dot(normal, r.rx_direction);
+    auto ny = dot(normal, r.ry_direction);
+    if (fabs(nx) < 1e-12 || fabs(ny) < 1e-12)
+    {
+        return;
+    }
+
+    auto d = dot(normal, p);
+    auto px = r.rx_origin + ((d - dot(normal, r.rx_origin)) / nx) * r.rx_direction;
+    auto py = r.ry_origin + ((d - dot(normal, r.ry_origin)) / ny) * r.ry_direction;
+    dpdx = px - p;
+    dpdy = py - p;
+
+    double ux, vx, uy, vy;
+    uv_at(px, ux, vx);
+    uv_at(py, uy, vy);
+    dudx = ux - u;
+    dvdx = vx - v;
+    dudy = uy - u;
+    dvdy = vy - v;
+    if (wrap_u)
+    {
+        dudx -= std::round(dudx);
+        dudy -= std::round(dudy);
+    }
+    has_differentials = true;
+}
+
+texture_footprint hit_record::footprint() const
+{
+    texture_footprint result;
+    if (has_differentials)
+    {
+        result.uv = fmax(sqrt(dudx * dudx + dvdx * dvdx), sqrt(dudy * dudy + dvdy * dvdy));
+        result.p = fmax(dpdx.length(), dpdy.length());
+    }
+    return result;
+}
+
 class hittable
 {
 public:
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const = 0;
 
     virtual bool bounding_box(double time0, double time1, aabb& output_box) const = 0;
+
+    // Heap memory owned by the object beyond its own size, for memory reports.
+    virtual size_t heap_bytes() const { return 0; }
+
+    // Appends the materials the object and the objects it wraps refer to; may repeat some.
+    virtual void collect_materials(std::vector<material *> &out) const {}
 };
\ No newline at end of file
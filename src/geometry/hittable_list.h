@@ -44,21 +44,33 @@ public:
 
         return true;
     }
+
+    virtual size_t heap_bytes() const override
+    {
+        return objects.capacity() * sizeof(shared_ptr<hittable>);
+    }
+
+    virtual void collect_materials(std::vector<material *> &out) const override
+    {
+        for (const auto &object : objects)
+        {
+            object->collect_materials(out);
+        }
+    }
 };
 
 bool hittable_list::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
 {
-    hit_record temp_rec;
     bool hit_anything = false;
     auto closet_so_far = t_max;
 
+    // Objects only write the record when they report a closer hit, so it can be filled in place.
     for (const auto &object : objects)
     {
-        if (object->hit(r, t_min, closet_so_far, temp_rec))
+        if (object->hit(r, t_min, closet_so_far, rec))
         {
             hit_anything = true;
-            closet_so_far = temp_rec.t;
-            rec = temp_rec;
+            closet_so_far = rec.t;
         }
     }
 
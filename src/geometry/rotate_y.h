@@ -7,6 +7,7 @@ class rotate_y : public hittable
 {
 public:
     shared_ptr<hittable> ptr;
+    double angle;
     double sin_theta;
     double cos_theta;
     bool hasbox;
@@ -23,9 +24,16 @@ public:
         output_box = bbox;
         return hasbox;
     }
+
+    virtual size_t heap_bytes() const override { return ptr->heap_bytes(); }
+
+    virtual void collect_materials(std::vector<material *> &out) const override
+    {
+        ptr->collect_materials(out);
+    }
 };
 
-rotate_y::rotate_y(shared_ptr<hittable> p, double angle) : ptr(p)
+rotate_y::rotate_y(shared_ptr<hittable> p, double angle) : ptr(p), angle(angle)
 {
     auto radians = degrees_to_radians(angle);
     sin_theta = sin(radians);
@@ -18,16 +18,15 @@ public:
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
-    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    virtual void collect_materials(std::vector<material *> &out) const override
     {
-        output_box = aabb(center(0) - vec3(radius, radius, radius), center(0) + vec3(radius, radius, radius));
-        return true;
+        out.push_back(mat_ptr.get());
     }
 
-protected:
-    virtual point3 center(double time) const
+    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
     {
-        return center0;
+        output_box = aabb(center(0) - vec3(radius, radius, radius), center(0) + vec3(radius, radius, radius));
+        return true;
     }
 
     static void get_sphere_uv(const point3 &p, double &u, double &v)
@@ -45,6 +44,12 @@ protected:
         u = phi / (2 * pi);
         v = theta / pi;
     }
+
+protected:
+    virtual point3 center(double time) const
+    {
+        return center0;
+    }
 };
 
 bool sphere::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
@@ -77,7 +82,10 @@ bool sphere::hit(const ray &r, double t_min, double t_max, hit_record &rec) cons
     rec.p = r.at(rec.t);
     vec3 outward_normal = (rec.p - center(r.time())) / radius;
     rec.set_face_normal(r, outward_normal);
-    sphere::get_sphere_uv(rec.p, rec.u, rec.v);
-    rec.mat_ptr = mat_ptr;
+    sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+    rec.mat_ptr = mat_ptr.get();
+    auto hit_center = center(r.time());
+    rec.set_differentials(r, [&](const point3 &q, double &u, double &v)
+                          { get_sphere_uv(unit_vector(q - hit_center), u, v); }, true);
     return true;
 }
\ No newline at end of file
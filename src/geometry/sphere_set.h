@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "headers.h"
+#include "hittable.h"
+#include "sphere.h"
+#include "aabb.h"
+#include "material/material.h"
+
+// A cloud of static spheres stored as structure-of-arrays. The spheres are sorted into
+// leaves of LANES entries, each leaf occupying one LANES-aligned block of the arrays, so a
+// leaf is intersected by a single fixed-width loop the compiler turns into SIMD code.
+class sphere_set : public hittable
+{
+public:
+    static const int LANES = 8;
+
+    struct node
+    {
+        real min[3];
+        real max[3];
+        uint32_t offset; // leaf: first sphere; interior: index of the right child (left is next)
+        uint16_t count;  // spheres in the leaf, 0 for interior nodes
+        uint8_t axis;
+    };
+
+    std::vector<real> cx, cy, cz, radius;
+    std::vector<uint32_t> mat_index;
+    std::vector<shared_ptr<material>> materials;
+    std::vector<node> nodes;
+    aabb bbox;
+
+public:
+    sphere_set() {}
+
+    void reserve(size_t n);
+    void add(const point3 &center, double r, shared_ptr<material> m);
+
+    // Sorts the spheres into leaf blocks and builds the internal hierarchy. Must be called
+    // after the last add() and before the set is rendered.
+    void build();
+
+    size_t size() const { return sphere_count; }
+
+    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
+
+    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    {
+        output_box = bbox;
+        return !nodes.empty();
+    }
+
+    virtual size_t heap_bytes() const override
+    {
+        return (cx.capacity() + cy.capacity() + cz.capacity() + radius.capacity()) * sizeof(real) +
+               mat_index.capacity() * sizeof(uint32_t) +
+               materials.capacity() * sizeof(shared_ptr<material>) +
+               nodes.capacity() * sizeof(node);
+    }
+
+    virtual void collect_materials(std::vector<material *> &out) const override
+    {
+        for (const auto &m : materials)
+        {
+            out.push_back(m.get());
+        }
+    }
+
+private:
+    size_t sphere_count = 0;
+    std::unordered_map<const material *, uint32_t> material_lookup;
+
+    uint32_t build_node(std::vector<uint32_t> &order, size_t start, size_t end);
+    real hit_leaf(const node &leaf, const ray &r, real t_min, real t_max, uint32_t &index) const;
+};
+
+void sphere_set::reserve(size_t n)
+{
+    cx.reserve(n);
+    cy.reserve(n);
+    cz.reserve(n);
+    radius.reserve(n);
+    mat_index.reserve(n);
+}
+
+void sphere_set::add(const point3 &center, double r, shared_ptr<material> m)
+{
+    auto found = material_lookup.find(m.get());
+    uint32_t index;
+    if (found == material_lookup.end())
+    {
+        index = static_cast<uint32_t>(materials.size());
+        materials.push_back(m);
+        material_lookup[m.get()] = index;
+    }
+    else
+    {
+        index = found->second;
+    }
+
+    cx.push_back(center.x());
+    cy.push_back(center.y());
+    cz.push_back(center.z());
+    radius.push_back(r);
+    mat_index.push_back(index);
+    sphere_count++;
+}
+
+void sphere_set::build()
+{
+    nodes.clear();
+    if (sphere_count == 0)
+    {
+        return;
+    }
+
+    std::vector<uint32_t> order(sphere_count);
+    for (size_t i = 0; i < sphere_count; i++)
+    {
+        order[i] = static_cast<uint32_t>(i);
+    }
+
+    nodes.reserve(2 * (sphere_count / LANES + 1));
+    build_node(order, 0, sphere_count);
+
+    // Apply the leaf order and pad the tail so the last block can be read in full.
+    auto padded = (sphere_count + LANES - 1) / LANES * LANES;
+    auto permute = [&](auto &values)
+    {
+        std::remove_reference_t<decltype(values)> sorted(padded);
+        for (size_t i = 0; i < sphere_count; i++)
+        {
+            sorted[i] = values[order[i]];
+        }
+        values.swap(sorted);
+    };
+    permute(cx);
+    permute(cy);
+    permute(cz);
+    permute(radius);
+    permute(mat_index);
+
+    const auto &root = nodes[0];
+    bbox = aabb(point3(root.min[0], root.min[1], root.min[2]), point3(root.max[0], root.max[1], root.max[2]));
+}
+
+uint32_t sphere_set::build_node(std::vector<uint32_t> &order, size_t start, size_t end)
+{
+    auto index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back(node());
+
+    node n;
+    real centroid_min[3];
+    real centroid_max[3];
+    for (int a = 0; a < 3; a++)
+    {
+        n.min[a] = centroid_min[a] = infinity;
+        n.max[a] = centroid_max[a] = -infinity;
+    }
+
+    for (size_t i = start; i < end; i++)
+    {
+        auto s = order[i];
+        real c[3] = {cx[s], cy[s], cz[s]};
+        for (int a = 0; a < 3; a++)
+        {
+            n.min[a] = fmin(n.min[a], c[a] - radius[s]);
+            n.max[a] = fmax(n.max[a], c[a] + radius[s]);
+            centroid_min[a] = fmin(centroid_min[a], c[a]);
+            centroid_max[a] = fmax(centroid_max[a], c[a]);
+        }
+    }
+
+    auto span = end - start;
+    if (span <= LANES)
+    {
+        n.offset = static_cast<uint32_t>(start);
+        n.count = static_cast<uint16_t>(span);
+        n.axis = 0;
+        nodes[index] = n;
+        return index;
+    }
+
+    int axis = 0;
+    for (int a = 1; a < 3; a++)
+    {
+        if (centroid_max[a] - centroid_min[a] > centroid_max[axis] - centroid_min[axis])
+        {
+            axis = a;
+        }
+    }
+    const auto &key = axis == 0 ? cx : axis == 1 ? cy
+                                                 : cz;
+
+    // Keep the left half a whole number of blocks so every leaf starts on a block boundary.
+    auto blocks = (span + LANES - 1) / LANES;
+    auto mid = start + (blocks / 2) * LANES;
+    std::nth_element(order.begin() + start, order.begin() + mid, order.begin() + end,
+                     [&key](uint32_t a, uint32_t b)
+                     { return key[a] < key[b]; });
+
+    n.count = 0;
+    n.axis = static_cast<uint8_t>(axis);
+    build_node(order, start, mid);
+    n.offset = build_node(order, mid, end);
+    nodes[index] = n;
+    return index;
+}
+
+real sphere_set::hit_leaf(const node &leaf, const ray &r, real t_min, real t_max, uint32_t &index) const
+{
+    const auto ox = r.origin().x();
+    const auto oy = r.origin().y();
+    const auto oz = r.origin().z();
+    const auto dx = r.direction().x();
+    const auto dy = r.direction().y();
+    const auto dz = r.direction().z();
+    const auto a = dx * dx + dy * dy + dz * dz;
+    const auto inv_a = 1 / a;
+
+    const real *px = cx.data() + leaf.offset;
+    const real *py = cy.data() + leaf.offset;
+    const real *pz = cz.data() + leaf.offset;
+    const real *pr = radius.data() + leaf.offset;
+
+    real t[LANES];
+    for (int l = 0; l < LANES; l++)
+    {
+        auto ocx = ox - px[l];
+        auto ocy = oy - py[l];
+        auto ocz = oz - pz[l];
+        auto half_b = dx * ocx + dy * ocy + dz * ocz;
+        auto c = ocx * ocx + ocy * ocy + ocz * ocz - pr[l] * pr[l];
+        auto discriminant = half_b * half_b - a * c;
+        auto sqrtd = sqrt(fmax(discriminant, real(0)));
+        auto t_near = (-half_b - sqrtd) * inv_a;
+        auto t_far = (-half_b + sqrtd) * inv_a;
+        auto root = (t_near >= t_min && t_near <= t_max) ? t_near : t_far;
+        bool valid = discriminant >= 0 && root >= t_min && root <= t_max && l < leaf.count;
+        t[l] = valid ? root : infinity;
+    }
+
+    real closest = infinity;
+    for (int l = 0; l < leaf.count; l++)
+    {
+        if (t[l] < closest)
+        {
+            closest = t[l];
+            index = leaf.offset + l;
+        }
+    }
+    return closest;
+}
+
+bool sphere_set::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
+{
+    if (nodes.empty())
+    {
+        return false;
+    }
+
+    real origin[3] = {r.origin().x(), r.origin().y(), r.origin().z()};
+    real inv_dir[3] = {1 / r.direction().x(), 1 / r.direction().y(), 1 / r.direction().z()};
+
+    uint32_t stack[64];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    bool hit_anything = false;
+    uint32_t hit_index = 0;
+
+    while (stack_size > 0)
+    {
+        auto index = stack[--stack_size];
+        const auto &n = nodes[index];
+
+        real t0 = t_min;
+        real t1 = t_max;
+        for (int a = 0; a < 3; a++)
+        {
+            auto t_near = (n.min[a] - origin[a]) * inv_dir[a];
+            auto t_far = (n.max[a] - origin[a]) * inv_dir[a];
+            if (inv_dir[a] < 0)
+            {
+                std::swap(t_near, t_far);
+            }
+            t0 = t_near > t0 ? t_near : t0;
+            t1 = t_far < t1 ? t_far : t1;
+        }
+        if (t1 <= t0)
+        {
+            continue;
+        }
+
+        if (n.count > 0)
+        {
+            uint32_t leaf_index;
+            auto t = hit_leaf(n, r, t_min, t_max, leaf_index);
+            if (t < t_max)
+            {
+                t_max = t;
+                hit_index = leaf_index;
+                hit_anything = true;
+            }
+            continue;
+        }
+
+        // Visit the child on the ray's side of the split first.
+        auto left = index + 1;
+        auto right = n.offset;
+        if (inv_dir[n.axis] < 0)
+        {
+            stack[stack_size++] = left;
+            stack[stack_size++] = right;
+        }
+        else
+        {
+            stack[stack_size++] = right;
+            stack[stack_size++] = left;
+        }
+    }
+
+    if (!hit_anything)
+    {
+        return false;
+    }
+
+    auto center = point3(cx[hit_index], cy[hit_index], cz[hit_index]);
+    rec.t = t_max;
+    rec.p = r.at(rec.t);
+    vec3 outward_normal = (rec.p - center) / radius[hit_index];
+    rec.set_face_normal(r, outward_normal);
+    sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+    rec.mat_ptr = materials[mat_index[hit_index]].get();
+    rec.set_differentials(r, [&](const point3 &q, double &u, double &v)
+                          { sphere::get_sphere_uv(unit_vector(q - center), u, v); }, true);
+    return true;
+}
@@ -0,0 +1,292 @@
+#pragma once
+
+#include "headers.h"
+#include "hittable.h"
+#include "translate.h"
+#include "rotate_y.h"
+#include "sphere.h"
+#include "aarect.h"
+#include "box.h"
+#include <typeinfo>
+#include <Eigen/Dense>
+
+// Object-to-world affine transform: the left 3x3 block is the linear part, the last column the translation.
+using affine3 = Eigen::Matrix<double, 3, 4>;
+
+inline affine3 affine_identity()
+{
+    affine3 m;
+    m << 1, 0, 0, 0,
+        0, 1, 0, 0,
+        0, 0, 1, 0;
+    return m;
+}
+
+inline affine3 affine_translation(const vec3 &offset)
+{
+    affine3 m = affine_identity();
+    m(0, 3) = offset.x();
+    m(1, 3) = offset.y();
+    m(2, 3) = offset.z();
+    return m;
+}
+
+// Same rotation as rotate_y: object space +x turns towards -z for positive angles.
+inline affine3 affine_rotation_y(double angle)
+{
+    auto radians = degrees_to_radians(angle);
+    auto sin_theta = sin(radians);
+    auto cos_theta = cos(radians);
+
+    affine3 m;
+    m << cos_theta, 0, sin_theta, 0,
+        0, 1, 0, 0,
+        -sin_theta, 0, cos_theta, 0;
+    return m;
+}
+
+// Returns a * b, i.e. b is applied first.
+inline affine3 affine_compose(const affine3 &a, const affine3 &b)
+{
+    affine3 m;
+    m.leftCols<3>() = a.leftCols<3>() * b.leftCols<3>();
+    m.col(3) = a.leftCols<3>() * b.col(3) + a.col(3);
+    return m;
+}
+
+inline affine3 affine_inverse(const affine3 &m)
+{
+    affine3 inv;
+    inv.leftCols<3>() = m.leftCols<3>().inverse();
+    inv.col(3) = -(inv.leftCols<3>() * m.col(3));
+    return inv;
+}
+
+inline point3 transform_point(const affine3 &m, const point3 &p)
+{
+    return point3(m(0, 0) * p.x() + m(0, 1) * p.y() + m(0, 2) * p.z() + m(0, 3),
+                  m(1, 0) * p.x() + m(1, 1) * p.y() + m(1, 2) * p.z() + m(1, 3),
+                  m(2, 0) * p.x() + m(2, 1) * p.y() + m(2, 2) * p.z() + m(2, 3));
+}
+
+inline vec3 transform_vector(const affine3 &m, const vec3 &v)
+{
+    return vec3(m(0, 0) * v.x() + m(0, 1) * v.y() + m(0, 2) * v.z(),
+                m(1, 0) * v.x() + m(1, 1) * v.y() + m(1, 2) * v.z(),
+                m(2, 0) * v.x() + m(2, 1) * v.y() + m(2, 2) * v.z());
+}
+
+// Normals transform with the inverse transpose of the linear part.
+inline vec3 transform_normal(const affine3 &inv, const vec3 &n)
+{
+    return vec3(inv(0, 0) * n.x() + inv(1, 0) * n.y() + inv(2, 0) * n.z(),
+                inv(0, 1) * n.x() + inv(1, 1) * n.y() + inv(2, 1) * n.z(),
+                inv(0, 2) * n.x() + inv(1, 2) * n.y() + inv(2, 2) * n.z());
+}
+
+class transform_instance : public hittable
+{
+public:
+    shared_ptr<hittable> ptr;
+    affine3 to_world;
+    affine3 to_object;
+    bool hasbox;
+    aabb bbox;
+
+public:
+    transform_instance(shared_ptr<hittable> p, const affine3 &object_to_world);
+
+    virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
+
+    virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
+    {
+        output_box = bbox;
+        return hasbox;
+    }
+
+    virtual size_t heap_bytes() const override { return ptr->heap_bytes(); }
+
+    virtual void collect_materials(std::vector<material *> &out) const override
+    {
+        ptr->collect_materials(out);
+    }
+};
+
+transform_instance::transform_instance(shared_ptr<hittable> p, const affine3 &object_to_world)
+    : ptr(p), to_world(object_to_world), to_object(affine_inverse(object_to_world))
+{
+    hasbox = ptr->bounding_box(0, 1, bbox);
+
+    point3 min(infinity, infinity, infinity);
+    point3 max(-infinity, -infinity, -infinity);
+
+    for (int i = 0; i < 2; i++)
+    {
+        for (int j = 0; j < 2; j++)
+        {
+            for (int k = 0; k < 2; k++)
+            {
+                auto x = i * bbox.max().x() + (1 - i) * bbox.min().x();
+                auto y = j * bbox.max().y() + (1 - j) * bbox.min().y();
+                auto z = k * bbox.max().z() + (1 - k) * bbox.min().z();
+
+                auto tester = transform_point(to_world, point3(x, y, z));
+
+                for (int c = 0; c < 3; c++)
+                {
+                    min[c] = fmin(min[c], tester[c]);
+                    max[c] = fmax(max[c], tester[c]);
+                }
+            }
+        }
+    }
+
+    bbox = aabb(min, max);
+}
+
+bool transform_instance::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
+{
+    // The direction is not renormalized, so t is the same parameter in both spaces.
+    ray object_r(transform_point(to_object, r.origin()), transform_vector(to_object, r.direction()), r.time());
+    if (r.has_differentials)
+    {
+        object_r.has_differentials = true;
+        object_r.rx_origin = transform_point(to_object, r.rx_origin);
+        object_r.ry_origin = transform_point(to_object, r.ry_origin);
+        object_r.rx_direction = transform_vector(to_object, r.rx_direction);
+        object_r.ry_direction = transform_vector(to_object, r.ry_direction);
+    }
+
+    if (!ptr->hit(object_r, t_min, t_max, rec))
+    {
+        return false;
+    }
+
+    // The child already oriented the normal against the object space ray, and the
+    // inverse transpose preserves that orientation, so front_face stays valid.
+    rec.p = transform_point(to_world, rec.p);
+    rec.normal = unit_vector(transform_normal(to_object, rec.normal));
+    if (rec.has_differentials)
+    {
+        rec.dpdx = transform_vector(to_world, rec.dpdx);
+        rec.dpdy = transform_vector(to_world, rec.dpdy);
+    }
+
+    return true;
+}
+
+// Scene-load pass
+
+inline bool is_similarity(const affine3 &m, double &scale)
+{
+    Eigen::Matrix3d gram = m.leftCols<3>().transpose() * m.leftCols<3>();
+    auto s2 = gram(0, 0);
+    scale = sqrt(s2);
+    return (gram - s2 * Eigen::Matrix3d::Identity()).cwiseAbs().maxCoeff() < 1e-9 * s2;
+}
+
+inline bool is_pure_translation(const affine3 &m)
+{
+    return (m.leftCols<3>() - Eigen::Matrix3d::Identity()).cwiseAbs().maxCoeff() < 1e-12;
+}
+
+// Rewrites the primitive itself when the transform maps it onto a primitive of the same kind.
+// Returns nullptr when the geometry cannot absorb the transform.
+shared_ptr<hittable> bake_transform(const shared_ptr<hittable> &object, const affine3 &m)
+{
+    auto &type = typeid(*object);
+
+    if (type == typeid(sphere))
+    {
+        auto s = std::static_pointer_cast<sphere>(object);
+        double scale;
+        if (is_similarity(m, scale))
+        {
+            return make_scene_object<sphere>(transform_point(m, s->center0), s->radius * scale, s->mat_ptr);
+        }
+        return nullptr;
+    }
+
+    if (!is_pure_translation(m))
+    {
+        return nullptr;
+    }
+
+    auto dx = m(0, 3);
+    auto dy = m(1, 3);
+    auto dz = m(2, 3);
+
+    if (type == typeid(xy_rect))
+    {
+        auto q = std::static_pointer_cast<xy_rect>(object);
+        return make_scene_object<xy_rect>(q->x0 + dx, q->x1 + dx, q->y0 + dy, q->y1 + dy, q->k + dz, q->mat);
+    }
+    if (type == typeid(xz_rect))
+    {
+        auto q = std::static_pointer_cast<xz_rect>(object);
+        return make_scene_object<xz_rect>(q->x0 + dx, q->x1 + dx, q->z0 + dz, q->z1 + dz, q->k + dy, q->mp);
+    }
+    if (type == typeid(yz_rect))
+    {
+        auto q = std::static_pointer_cast<yz_rect>(object);
+        return make_scene_object<yz_rect>(q->y0 + dy, q->y1 + dy, q->z0 + dz, q->z1 + dz, q->k + dx, q->mp);
+    }
+    if (type == typeid(box))
+    {
+        auto b = std::static_pointer_cast<box>(object);
+        auto offset = vec3(dx, dy, dz);
+        return make_scene_object<box>(b->box_min + offset, b->box_max + offset, b->mat);
+    }
+
+    return nullptr;
+}
+
+// Collapses a chain of translate / rotate_y / transform_instance wrappers into a single
+// transform_instance. When the wrapped geometry is referenced by nothing but the chain, the
+// transform is baked into the primitive and no instance is created at all.
+shared_ptr<hittable> flatten_transforms(const shared_ptr<hittable> &object)
+{
+    auto m = affine_identity();
+    auto leaf = object;
+    int depth = 0;
+
+    while (true)
+    {
+        if (auto t = std::dynamic_pointer_cast<translate>(leaf))
+        {
+            m = affine_compose(m, affine_translation(t->offset));
+            leaf = t->ptr;
+        }
+        else if (auto r = std::dynamic_pointer_cast<rotate_y>(leaf))
+        {
+            m = affine_compose(m, affine_rotation_y(r->angle));
+            leaf = r->ptr;
+        }
+        else if (auto i = std::dynamic_pointer_cast<transform_instance>(leaf))
+        {
+            m = affine_compose(m, i->to_world);
+            leaf = i->ptr;
+        }
+        else
+        {
+            break;
+        }
+        depth++;
+    }
+
+    if (depth == 0)
+    {
+        return object;
+    }
+
+    // One reference from the innermost wrapper, one from `leaf` itself.
+    if (leaf.use_count() == 2)
+    {
+        if (auto baked = bake_transform(leaf, m))
+        {
+            return baked;
+        }
+    }
+
+    return make_scene_object<transform_instance>(leaf, m);
+}
@@ -17,6 +17,13 @@ public:
         const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override;
+
+    virtual size_t heap_bytes() const override { return ptr->heap_bytes(); }
+
+    virtual void collect_materials(std::vector<material *> &out) const override
+    {
+        ptr->collect_materials(out);
+    }
 };
 
 bool translate::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
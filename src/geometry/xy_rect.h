@@ -18,6 +18,11 @@ public:
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual void collect_materials(std::vector<material *> &out) const override
+    {
+        out.push_back(mat.get());
+    }
+
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
     {
         output_box = aabb(point3(x0, y0, k - 0.0001), point3(x1, y1, k + 0.0001));
@@ -47,8 +52,13 @@ xy_rect::hit(const ray &r, double t_min, double t_max, hit_record &rec) const
 
     auto outward_normal = vec3(0, 0, 1);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mat;
+    rec.mat_ptr = mat.get();
     rec.p = r.at(t);
+    rec.set_differentials(r, [this](const point3 &q, double &u, double &v)
+                          {
+                              u = (q.x() - x0) / (x1 - x0);
+                              v = (q.y() - y0) / (y1 - y0);
+                          });
 
     return true;
 }
\ No newline at end of file
@@ -16,6 +16,11 @@ public:
 
     virtual bool hit(const ray &r, double t_min, double t_max, hit_record &rec) const override;
 
+    virtual void collect_materials(std::vector<material *> &out) const override
+    {
+        out.push_back(mp.get());
+    }
+
     virtual bool bounding_box(double time0, double time1, aabb &output_box) const override
     {
         // The bounding box must have non-zero width in each dimension, so pad the Y
@@ -43,7 +48,12 @@ bool xz_rect::hit(const ray &r, double t_min, double t_max, hit_record &rec) con
     rec.t = t;
     auto outward_normal = vec3(0, 1, 0);
     rec.set_face_normal(r, outward_normal);
-    rec.mat_ptr = mp;
+    rec.mat_ptr = mp.get();
     rec.p = r.at(t);
+    rec.set_differentials(r, [this](const point3 &q, double &u, double &v)
+                          {
+                              u = (q.x() - x0) / (x1 - x0);
+                              v = (q.z() - z0) / (z1 - z0);
+                          });
     return true;
 }
\ No newline at end of file
@@ -1,11 +1,20 @@
 #pragma once
 
 #include <cmath>
+#include <cstdint>
 #include <limits>
 #include <memory>
 #include <random>
 #include "util.h"
 
+// Scalar type of the math core (vec3, ray, aabb, camera). Single precision is selected at
+// build time with RAY_SINGLE_PRECISION; double stays the default.
+#ifdef RAY_SINGLE_PRECISION
+using real = float;
+#else
+using real = double;
+#endif
+
 // Usings
 
 using std::make_shared;
@@ -24,8 +33,54 @@ inline double degrees_to_radians(double degrees)
     return degrees * pi / 180.0;
 }
 
+// Random stream of one pixel sample (splitmix64). Render threads install one per sample with
+// sample_rng::scope, so the numbers a sample draws depend only on the seed, its pixel and its
+// index, never on thread scheduling or on how the render was split or resumed.
+struct sample_rng
+{
+    uint64_t state;
+
+    sample_rng(uint64_t seed, uint64_t pixel, uint64_t sample) : state(seed)
+    {
+        state = mix(state ^ mix(pixel + 0x9e3779b97f4a7c15ull));
+        state = mix(state ^ mix(sample + 0xbf58476d1ce4e5b9ull));
+    }
+
+    double next_double()
+    {
+        state += 0x9e3779b97f4a7c15ull;
+        return (mix(state) >> 11) * 0x1.0p-53;
+    }
+
+    static uint64_t mix(uint64_t z)
+    {
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+        return z ^ (z >> 31);
+    }
+
+    // Stream used by random_double() on this thread; null outside of sample evaluation.
+    static sample_rng *&current()
+    {
+        thread_local sample_rng *rng = nullptr;
+        return rng;
+    }
+
+    struct scope
+    {
+        sample_rng *previous;
+        scope(sample_rng &rng) : previous(current()) { current() = &rng; }
+        ~scope() { current() = previous; }
+    };
+};
+
 inline double random_double()
 {
+    if (auto rng = sample_rng::current())
+    {
+        return rng->next_double();
+    }
+    // Scene construction draws from one shared generator, so scenes are the same in every run.
     static std::uniform_real_distribution<double> distribution(0.0, 1.0);
     static std::mt19937 generator;
     return distribution(generator);
@@ -57,4 +112,5 @@ inline double clamp(double x, double min, double max)
 // Common Headers
 
 #include "ray.h"
-#include "vec3.h"
\ No newline at end of file
+#include "vec3.h"
+#include "memory/scene_arena.h"
\ No newline at end of file
@@ -0,0 +1,226 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "image/film.h"
+
+// Progress of a render, saved as a checkpoint or as a partial render for merging. Samples are
+// rendered in passes of `pass_samples` per pixel and every sample draws from a stream seeded by
+// (seed, pixel, sample index), so the film plus the number of samples finished in each row is all
+// that is needed to continue an interrupted render and end with the same image as an
+// uninterrupted run.
+//
+// A render may cover only the sample indices [sample_begin, sample_end) of an image with
+// `samples_per_pixel` samples, and only the pixels of `region`; renders of disjoint ranges or
+// regions or with different seeds merge into one.
+struct render_state
+{
+    // Samples of one render: the indices [sample_begin, sample_end) drawn with `seed` in every
+    // pixel of `region`.
+    struct sample_set
+    {
+        uint64_t seed = 0;
+        int sample_begin = 0;
+        int sample_end = 0;
+        film_region region;
+
+        bool overlaps(const sample_set &other) const
+        {
+            return seed == other.seed && sample_begin < other.sample_end && other.sample_begin < sample_end &&
+                   region.intersects(other.region);
+        }
+    };
+
+    std::string scene;
+    int samples_per_pixel = 0;
+    int pass_samples = 0;
+    int sample_begin = 0;
+    int sample_end = 0;
+    uint64_t seed = 0;
+    std::string filter = "box"; // reconstruction filter the samples were splatted with
+    film_region region;         // pixels rendered, the whole film unless cropped
+    // Options that change the samples themselves: -ray_differentials, -texture_compression and
+    // -bake_textures.
+    bool ray_differentials = false;
+    std::string texture_compression;
+    int bake_textures = 0;
+    std::vector<sample_set> merged_sets; // sets of the renders merged into this one, empty if none were
+    std::vector<int> row_samples; // samples per pixel accumulated in each film row
+    film image;
+
+    bool load(const std::string &path);
+    bool save(const std::string &path) const;
+
+    // Whether `other` was rendered with the same filter and sample-changing options.
+    bool same_options(const render_state &other) const;
+
+    // The sample sets accumulated in the film: merged_sets, or this render's own set.
+    std::vector<sample_set> sample_sets() const;
+
+    // Whether `other` holds samples this state already has: the same indices of the same pixels
+    // with the same seed.
+    bool overlaps(const render_state &other) const;
+
+    // Adds the samples of `other`, a render of the same scene, size and samples_per_pixel with
+    // the same options and no samples in common with this one.
+    bool merge(const render_state &other);
+};
+
+bool render_state::load(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[4];
+    // width, height, optional film channels, samples_per_pixel, pass_samples, sample_begin, sample_end, scene name length,
+    // filter name length, region x0, y0, x1, y1, ray differentials, texture compression name length, bake_textures,
+    // merged sample set count
+    int header[17];
+    if (!in.read(magic, 4) || std::memcmp(magic, "RTC8", 4) != 0 ||
+        !in.read(reinterpret_cast<char *>(header), sizeof(header)) || header[0] <= 0 || header[1] <= 0 ||
+        (header[2] & ~(film::VARIANCE | film::AOVS)) != 0 || header[7] < 0 || header[8] < 0 ||
+        header[9] < 0 || header[10] < 0 || header[11] <= header[9] || header[12] <= header[10] ||
+        header[11] > header[0] || header[12] > header[1] || header[14] < 0 || header[16] < 0)
+    {
+        return false;
+    }
+    std::string name(header[7], '\0');
+    std::string filter_name(header[8], '\0');
+    std::string compression(header[14], '\0');
+    uint64_t stream_seed;
+    if (!in.read(name.data(), name.size()) || !in.read(filter_name.data(), filter_name.size()) ||
+        !in.read(compression.data(), compression.size()) || !in.read(reinterpret_cast<char *>(&stream_seed), sizeof(stream_seed)))
+    {
+        return false;
+    }
+    std::vector<sample_set> sets(header[16]);
+    for (auto &set : sets)
+    {
+        // sample_begin, sample_end, region x0, y0, x1, y1
+        int fields[6];
+        if (!in.read(reinterpret_cast<char *>(&set.seed), sizeof(set.seed)) || !in.read(reinterpret_cast<char *>(fields), sizeof(fields)))
+        {
+            return false;
+        }
+        set.sample_begin = fields[0];
+        set.sample_end = fields[1];
+        set.region = {fields[2], fields[3], fields[4], fields[5]};
+    }
+    std::vector<int> rows(header[1]);
+    film data(header[0], header[1], header[2]);
+    if (!in.read(reinterpret_cast<char *>(rows.data()), rows.size() * sizeof(int)) ||
+        !in.read(reinterpret_cast<char *>(data.data()), data.size() * sizeof(float)))
+    {
+        return false;
+    }
+    scene = std::move(name);
+    samples_per_pixel = header[3];
+    pass_samples = header[4];
+    sample_begin = header[5];
+    sample_end = header[6];
+    seed = stream_seed;
+    filter = std::move(filter_name);
+    region = {header[9], header[10], header[11], header[12]};
+    ray_differentials = header[13] != 0;
+    texture_compression = std::move(compression);
+    bake_textures = header[15];
+    merged_sets = std::move(sets);
+    row_samples = std::move(rows);
+    image = std::move(data);
+    return true;
+}
+
+// Writes to a temporary file and renames it over `path`, so an interruption while saving never
+// destroys the previous checkpoint.
+bool render_state::save(const std::string &path) const
+{
+    auto temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::binary);
+        int header[17] = {image.width(), image.height(), static_cast<int>(image.channels()), samples_per_pixel, pass_samples,
+                          sample_begin, sample_end, static_cast<int>(scene.size()), static_cast<int>(filter.size()),
+                          region.x0, region.y0, region.x1, region.y1, ray_differentials ? 1 : 0,
+                          static_cast<int>(texture_compression.size()), bake_textures, static_cast<int>(merged_sets.size())};
+        out.write("RTC8", 4);
+        out.write(reinterpret_cast<const char *>(header), sizeof(header));
+        out.write(scene.data(), scene.size());
+        out.write(filter.data(), filter.size());
+        out.write(texture_compression.data(), texture_compression.size());
+        out.write(reinterpret_cast<const char *>(&seed), sizeof(seed));
+        for (const auto &set : merged_sets)
+        {
+            int fields[6] = {set.sample_begin, set.sample_end, set.region.x0, set.region.y0, set.region.x1, set.region.y1};
+            out.write(reinterpret_cast<const char *>(&set.seed), sizeof(set.seed));
+            out.write(reinterpret_cast<const char *>(fields), sizeof(fields));
+        }
+        out.write(reinterpret_cast<const char *>(row_samples.data()), row_samples.size() * sizeof(int));
+        out.write(reinterpret_cast<const char *>(image.data()), image.size() * sizeof(float));
+        out.flush();
+        if (!out)
+        {
+            return false;
+        }
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool render_state::same_options(const render_state &other) const
+{
+    return other.filter == filter && other.ray_differentials == ray_differentials &&
+           other.texture_compression == texture_compression && other.bake_textures == bake_textures;
+}
+
+std::vector<render_state::sample_set> render_state::sample_sets() const
+{
+    if (!merged_sets.empty())
+    {
+        return merged_sets;
+    }
+    return {sample_set{seed, sample_begin, sample_end, region}};
+}
+
+bool render_state::overlaps(const render_state &other) const
+{
+    auto other_sets = other.sample_sets();
+    for (const auto &set : sample_sets())
+    {
+        for (const auto &other_set : other_sets)
+        {
+            if (set.overlaps(other_set))
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// The merged state counts all samples per row, the sample indices from the lowest to the highest
+// of both and the bounds of both regions, and keeps the sample sets of both so later merges are
+// checked against every render in it; it can be merged further but not resumed.
+bool render_state::merge(const render_state &other)
+{
+    if (other.scene != scene || !same_options(other) || other.samples_per_pixel != samples_per_pixel ||
+        other.image.width() != image.width() || other.image.height() != image.height() || overlaps(other))
+    {
+        return false;
+    }
+    auto sets = sample_sets();
+    auto other_sets = other.sample_sets();
+    sets.insert(sets.end(), other_sets.begin(), other_sets.end());
+    merged_sets = std::move(sets);
+    image.merge(other.image);
+    for (size_t y = 0; y < row_samples.size(); y++)
+    {
+        row_samples[y] += other.row_samples[y];
+    }
+    sample_begin = std::min(sample_begin, other.sample_begin);
+    sample_end = std::max(sample_end, other.sample_end);
+    region = {std::min(region.x0, other.region.x0), std::min(region.y0, other.region.y0),
+              std::max(region.x1, other.region.x1), std::max(region.y1, other.region.y1)};
+    pass_samples = 0;
+    return true;
+}
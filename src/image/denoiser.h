@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include "image/film.h"
+#include "image/parallel.h"
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) with variance guided color weights
+// as in SVGF. Each iteration blurs with a 5x5 B3 spline kernel whose taps are spread 2^i pixels
+// apart, and weights every tap by how much it differs from the center in normal, albedo, relative
+// depth and, relative to the center's noise, luminance.
+struct denoise_settings
+{
+    int iterations = 5;
+    float sigma_luminance = 8; // in standard deviations of the pixel mean
+    float sigma_normal = 0.25f;
+    float sigma_albedo = 0.1f;
+    float sigma_depth = 0.01f; // relative depth difference per pixel of tap distance
+};
+
+// exp(-x) for x >= 0 as (1 - x / 32)^32: close enough for filter weights, and unlike exp() it
+// vectorizes.
+inline float denoise_falloff(float x)
+{
+    // max(t, 0) without a comparison, which would keep the filter loop from vectorizing.
+    auto t = 1 - x * (1.0f / 32);
+    t = 0.5f * (t + std::fabs(t));
+    t *= t;
+    t *= t;
+    t *= t;
+    t *= t;
+    t *= t;
+    return t;
+}
+
+// Edge-stopping guides of the filter as planes, rows top to bottom.
+struct denoise_guides
+{
+    int width = 0;
+    int height = 0;
+    std::vector<float> normal[3];
+    std::vector<float> albedo[3];
+    std::vector<float> depth;
+};
+
+// The filtered signal; iterations ping-pong between two of these.
+struct denoise_signal
+{
+    std::vector<float> color[3];
+    std::vector<float> luminance;
+    std::vector<float> variance;
+    std::vector<float> blurred_variance; // over 3x3 pixels, for the luminance weights
+
+    void resize(size_t n)
+    {
+        for (auto &c : color)
+        {
+            c.resize(n);
+        }
+        luminance.resize(n);
+        variance.resize(n);
+        blurred_variance.resize(n);
+    }
+};
+
+// Blurs the variance of rows [first, last) of `signal` with a 3x3 binomial kernel, as a single
+// pixel's estimate from few samples is itself too noisy to scale the luminance weights.
+inline void denoise_blur_variance(denoise_signal &signal, int width, int height, int first, int last)
+{
+    for (int y = first; y < last; y++)
+    {
+        auto out = signal.blurred_variance.data() + size_t(y) * width;
+        std::fill(out, out + width, 0.0f);
+        for (int ky = -1; ky <= 1; ky++)
+        {
+            auto variance = signal.variance.data() + size_t(std::min(std::max(y + ky, 0), height - 1)) * width;
+            auto wy = ky == 0 ? 0.5f : 0.25f;
+            for (int x = 0; x < width; x++)
+            {
+                auto left = variance[x > 0 ? x - 1 : x];
+                auto right = variance[x + 1 < width ? x + 1 : x];
+                out[x] += wy * (0.25f * left + 0.5f * variance[x] + 0.25f * right);
+            }
+        }
+        for (int x = 0; x < width; x++)
+        {
+            out[x] = std::sqrt(out[x]);
+        }
+    }
+}
+
+// One a-trous iteration with taps `step` pixels apart over rows [first, last) from `in` into
+// `out`. Every tap is a loop over a contiguous run of the row.
+inline void denoise_rows(const denoise_guides &guides, const denoise_signal &in, denoise_signal &out, const denoise_settings &settings,
+                         int step, int first, int last)
+{
+    static const float kernel[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+    auto w = guides.width;
+    auto inv_normal = 1 / (settings.sigma_normal * settings.sigma_normal);
+    auto inv_albedo = 1 / (settings.sigma_albedo * settings.sigma_albedo);
+    auto sigma_l2 = settings.sigma_luminance * settings.sigma_luminance;
+    auto sigma_z = settings.sigma_depth * step;
+    std::vector<float> inv_depth(w), sum_weight(w), sum_variance(w), sum_color[3];
+    for (auto &s : sum_color)
+    {
+        s.resize(w);
+    }
+
+    for (int y = first; y < last; y++)
+    {
+        auto row = size_t(y) * w;
+        auto depth = guides.depth.data() + row;
+        for (int x = 0; x < w; x++)
+        {
+            auto z = sigma_z * depth[x];
+            inv_depth[x] = 1 / (z * z + 1e-8f);
+        }
+        std::fill(sum_weight.begin(), sum_weight.end(), 0.0f);
+        std::fill(sum_variance.begin(), sum_variance.end(), 0.0f);
+        for (auto &s : sum_color)
+        {
+            std::fill(s.begin(), s.end(), 0.0f);
+        }
+
+        for (int ky = 0; ky < 5; ky++)
+        {
+            auto yy = y + (ky - 2) * step;
+            if (yy < 0 || yy >= guides.height)
+            {
+                continue;
+            }
+            for (int kx = 0; kx < 5; kx++)
+            {
+                auto dx = (kx - 2) * step;
+                auto x0 = std::max(0, -dx);
+                auto x1 = std::min(w, w - dx);
+                auto h = kernel[ky] * kernel[kx];
+                auto tap = std::ptrdiff_t(yy) * w + dx;
+                auto lp = in.luminance.data() + row, lq = in.luminance.data() + tap;
+                auto np0 = guides.normal[0].data() + row, nq0 = guides.normal[0].data() + tap;
+                auto np1 = guides.normal[1].data() + row, nq1 = guides.normal[1].data() + tap;
+                auto np2 = guides.normal[2].data() + row, nq2 = guides.normal[2].data() + tap;
+                auto ap0 = guides.albedo[0].data() + row, aq0 = guides.albedo[0].data() + tap;
+                auto ap1 = guides.albedo[1].data() + row, aq1 = guides.albedo[1].data() + tap;
+                auto ap2 = guides.albedo[2].data() + row, aq2 = guides.albedo[2].data() + tap;
+                auto zp = guides.depth.data() + row, zq = guides.depth.data() + tap;
+                auto cq0 = in.color[0].data() + tap, cq1 = in.color[1].data() + tap, cq2 = in.color[2].data() + tap;
+                auto vq = in.variance.data() + tap;
+                auto bp = in.blurred_variance.data() + row, bq = in.blurred_variance.data() + tap;
+                auto iz = inv_depth.data();
+                auto sw = sum_weight.data(), sv = sum_variance.data();
+                auto sc0 = sum_color[0].data(), sc1 = sum_color[1].data(), sc2 = sum_color[2].data();
+                // The sums never alias the inputs; without this GCC gives up on the run-time alias
+                // checks of this many streams and leaves the loop scalar.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC ivdep
+#endif
+                for (int x = x0; x < x1; x++)
+                {
+                    auto dl = lp[x] - lq[x];
+                    auto dn0 = np0[x] - nq0[x], dn1 = np1[x] - nq1[x], dn2 = np2[x] - nq2[x];
+                    auto da0 = ap0[x] - aq0[x], da1 = ap1[x] - aq1[x], da2 = ap2[x] - aq2[x];
+                    auto dz = zp[x] - zq[x];
+                    auto e = dl * dl / (sigma_l2 * bp[x] * bq[x] + 1e-8f) + (dn0 * dn0 + dn1 * dn1 + dn2 * dn2) * inv_normal +
+                             (da0 * da0 + da1 * da1 + da2 * da2) * inv_albedo + dz * dz * iz[x];
+                    auto weight = h * denoise_falloff(e);
+                    sw[x] += weight;
+                    sc0[x] += weight * cq0[x];
+                    sc1[x] += weight * cq1[x];
+                    sc2[x] += weight * cq2[x];
+                    sv[x] += weight * weight * vq[x];
+                }
+            }
+        }
+
+        // The center tap always has weight kernel[2]^2, so the sums are never zero.
+        auto c0 = out.color[0].data() + row, c1 = out.color[1].data() + row, c2 = out.color[2].data() + row;
+        auto l = out.luminance.data() + row, v = out.variance.data() + row;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC ivdep
+#endif
+        for (int x = 0; x < w; x++)
+        {
+            auto inv = 1 / sum_weight[x];
+            c0[x] = sum_color[0][x] * inv;
+            c1[x] = sum_color[1][x] * inv;
+            c2[x] = sum_color[2][x] * inv;
+            l[x] = 0.2126f * c0[x] + 0.7152f * c1[x] + 0.0722f * c2[x];
+            v[x] = sum_variance[x] * inv * inv;
+        }
+    }
+}
+
+// Denoises the radiance of `image` on up to `threads` threads and returns it as a film of the
+// same size and weights without optional channels. Normal, albedo and depth come from the film's
+// AOVs and the noise level from its variance plane; without them the filter falls back to color
+// only and to a variance estimated from each pixel's 3x3 neighbourhood.
+inline film denoise(const film &image, const denoise_settings &settings, int threads)
+{
+    auto w = image.width();
+    auto h = image.height();
+    auto n = image.pixel_count();
+    denoise_guides guides;
+    guides.width = w;
+    guides.height = h;
+    guides.depth.assign(n, 0.0f);
+    for (int c = 0; c < 3; c++)
+    {
+        guides.normal[c].assign(n, 0.0f);
+        guides.albedo[c].assign(n, 0.0f);
+    }
+    denoise_signal signals[2];
+    signals[0].resize(n);
+    signals[1].resize(n);
+
+    auto &in = signals[0];
+    auto resolve_rows = [&](int first, int last)
+    {
+        for (int y = first; y < last; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                auto i = size_t(y) * w + x;
+                auto c = image.average(x, y);
+                in.color[0][i] = static_cast<float>(c.x());
+                in.color[1][i] = static_cast<float>(c.y());
+                in.color[2][i] = static_cast<float>(c.z());
+                in.luminance[i] = static_cast<float>(::luminance(c));
+                in.variance[i] = image.variance(x, y);
+                if (image.has_aovs())
+                {
+                    guides.depth[i] = image.aov(0, x, y);
+                    for (int k = 0; k < 3; k++)
+                    {
+                        guides.normal[k][i] = image.aov(1 + k, x, y);
+                        guides.albedo[k][i] = image.aov(4 + k, x, y);
+                    }
+                }
+            }
+        }
+    };
+    parallel_ranges(h, threads, resolve_rows);
+
+    if (!image.has_variance())
+    {
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                double sum = 0, sum_squares = 0;
+                int count = 0;
+                for (int yy = std::max(0, y - 1); yy <= std::min(h - 1, y + 1); yy++)
+                {
+                    for (int xx = std::max(0, x - 1); xx <= std::min(w - 1, x + 1); xx++)
+                    {
+                        auto l = in.luminance[size_t(yy) * w + xx];
+                        sum += l;
+                        sum_squares += l * l;
+                        count++;
+                    }
+                }
+                auto mean = sum / count;
+                in.variance[size_t(y) * w + x] = static_cast<float>(std::max(sum_squares / count - mean * mean, 0.0));
+            }
+        }
+    }
+
+    int current = 0;
+    for (int i = 0; i < settings.iterations; i++)
+    {
+        auto blur_rows = [&](int first, int last)
+        {
+            denoise_blur_variance(signals[current], w, h, first, last);
+        };
+        parallel_ranges(h, threads, blur_rows);
+        auto filter_rows = [&](int first, int last)
+        {
+            denoise_rows(guides, signals[current], signals[1 - current], settings, 1 << i, first, last);
+        };
+        parallel_ranges(h, threads, filter_rows);
+        current = 1 - current;
+    }
+
+    auto &result = signals[current];
+    film denoised(w, h);
+    for (int y = 0; y < h; y++)
+    {
+        auto weight = image.row(3, y);
+        auto row = size_t(y) * w;
+        for (int c = 0; c < 3; c++)
+        {
+            auto out = denoised.row(c, y);
+            for (int x = 0; x < w; x++)
+            {
+                out[x] = result.color[c][row + x] * weight[x];
+            }
+        }
+        std::copy(weight, weight + w, denoised.row(3, y));
+    }
+    return denoised;
+}
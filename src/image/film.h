@@ -0,0 +1,324 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <vector>
+#include "headers.h"
+#include "color.h"
+
+// Arbitrary output variables: per sample values recorded next to the radiance, averaged per pixel
+// like it. `offset` is the first of the `planes` the variable occupies within the AOV planes; the
+// IDs follow them and are not averaged, since the average of two ids names a third object.
+struct aov_channel
+{
+    const char *name;
+    int offset;
+    int planes;
+};
+
+static const aov_channel AOV_CHANNELS[] = {
+    {"depth", 0, 1},     // distance from the camera to the first hit, 0 where the ray escapes
+    {"normal", 1, 3},    // world space normal at the first hit, facing the camera
+    {"albedo", 4, 3},    // texture color at the first hit, the background where the ray escapes
+    {"direct", 7, 3},    // radiance from lights and background, scattered at most once
+    {"indirect", 10, 3}, // radiance scattered two or more times
+    {"material", 13, 1}, // index into compiled_scene::materials of the sample nearest the pixel center, -1 if none
+    {"object", 14, 1}    // index of that sample's primitive in compiled_scene, -1 if none
+};
+
+// IDs of the surface a camera sample hit first, -1 where the ray escaped.
+struct sample_ids
+{
+    float material = -1;
+    float object = -1;
+};
+
+// Pixels [x0, x1) x [y0, y1) of a film, rows top to bottom.
+struct film_region
+{
+    int x0 = 0;
+    int y0 = 0;
+    int x1 = 0;
+    int y1 = 0;
+
+    int width() const { return x1 - x0; }
+    int height() const { return y1 - y0; }
+    bool contains(int x, int y) const { return x >= x0 && x < x1 && y >= y0 && y < y1; }
+    bool intersects(const film_region &other) const
+    {
+        return x0 < other.x1 && other.x0 < x1 && y0 < other.y1 && other.y0 < y1;
+    }
+    bool operator==(const film_region &other) const
+    {
+        return x0 == other.x0 && y0 == other.y0 && x1 == other.x1 && y1 == other.y1;
+    }
+    bool operator!=(const film_region &other) const { return !(*this == other); }
+};
+
+// Accumulation buffer of a render: per pixel the weighted sum of the radiance samples and the sum
+// of their weights, in float. Channels are stored as separate planes (red, green, blue, weight)
+// so post-processing loops run over contiguous floats. Rows are top to bottom. Optional channels
+// follow: the sum of squared sample luminances, from which the variance of each pixel follows, and
+// the sums of the AOVs and the ID planes. The ID planes hold the ids of the sample nearest the
+// pixel center and its squared distance to it; adding samples or films keeps the nearer sample
+// rather than summing, so every pixel carries the exact ids of one sample.
+//
+// Films of the same size merge by adding their planes, which is how partial renders of disjoint
+// samples or regions combine into one image.
+//
+// With a reconstruction filter wider than a pixel the weights are filter weights rather than
+// sample counts and every channel, the squared luminances included, is weighted alike; variances
+// are then approximate.
+//
+// The film is shared by all render threads without locking; each pixel must only be written by
+// one thread at a time, which holds as long as threads render disjoint rows.
+class film
+{
+public:
+    static const int PLANES = 4;
+    static const int AOV_PLANES = 13;
+    static const int ID_PLANES = 3; // squared distance, material, object
+
+    // Optional channels.
+    static const unsigned VARIANCE = 1;
+    static const unsigned AOVS = 2;
+
+public:
+    film() {}
+    film(int width, int height, unsigned channels = 0)
+        : w(width), h(height), optional(channels), planes(size_t(width) * height * plane_count(channels), 0.0f)
+    {
+        if (has_aovs())
+        {
+            auto n = pixel_count();
+            auto ids = planes.begin() + id_plane() * n;
+            std::fill(ids, ids + n, std::numeric_limits<float>::infinity());
+            std::fill(ids + n, ids + ID_PLANES * n, -1.0f);
+        }
+    }
+
+    int width() const { return w; }
+    int height() const { return h; }
+    size_t pixel_count() const { return size_t(w) * h; }
+    unsigned channels() const { return optional; }
+    bool has_variance() const { return optional & VARIANCE; }
+    bool has_aovs() const { return optional & AOVS; }
+
+    static int plane_count(unsigned channels)
+    {
+        return PLANES + (channels & VARIANCE ? 1 : 0) + (channels & AOVS ? AOV_PLANES + ID_PLANES : 0);
+    }
+
+    // Adds `radiance`, the sum of samples of total weight `weight`, to pixel (x, y).
+    // `squared_luminance` is the sum of the samples' squared luminances, kept with variance only.
+    void add(int x, int y, const color &radiance, double weight, double squared_luminance = 0)
+    {
+        auto i = size_t(y) * w + x;
+        auto n = pixel_count();
+        planes[i] += static_cast<float>(radiance.x());
+        planes[n + i] += static_cast<float>(radiance.y());
+        planes[2 * n + i] += static_cast<float>(radiance.z());
+        planes[3 * n + i] += static_cast<float>(weight);
+        if (has_variance())
+        {
+            planes[PLANES * n + i] += static_cast<float>(squared_luminance);
+        }
+    }
+
+    // Adds the AOV_PLANES sums of the AOVs of the samples added to pixel (x, y).
+    void add_aovs(int x, int y, const float *sums)
+    {
+        auto i = size_t(y) * w + x;
+        auto n = pixel_count();
+        auto first = aov_plane();
+        for (int c = 0; c < AOV_PLANES; c++)
+        {
+            planes[(first + c) * n + i] += sums[c];
+        }
+    }
+
+    // Records `ids` for pixel (x, y) if their sample lies nearer to the pixel center than the
+    // one recorded so far, at squared distance `distance`.
+    void keep_ids(int x, int y, float distance, const sample_ids &ids)
+    {
+        auto i = size_t(y) * w + x;
+        auto n = pixel_count();
+        auto first = id_plane();
+        if (distance < planes[first * n + i])
+        {
+            planes[first * n + i] = distance;
+            planes[(first + 1) * n + i] = ids.material;
+            planes[(first + 2) * n + i] = ids.object;
+        }
+    }
+
+    // Adds all samples of `other`, a film of the same size. The result keeps only the optional
+    // channels both films have.
+    void merge(const film &other)
+    {
+        auto common = optional & other.optional;
+        if (common != optional)
+        {
+            film kept(w, h, common);
+            kept.copy_planes(*this);
+            *this = std::move(kept);
+        }
+        film added(w, h, common);
+        added.copy_planes(other);
+        auto n = pixel_count();
+        auto summed = has_aovs() ? id_plane() * n : planes.size();
+        for (size_t i = 0; i < summed; i++)
+        {
+            planes[i] += added.planes[i];
+        }
+        if (has_aovs())
+        {
+            keep_nearer_ids(added, 0, 0, n);
+        }
+    }
+
+    // Adds `band`, a film of the same width and channels whose row 0 is row `offset` of this film,
+    // to this film's rows [first, last). Each row is only written by the caller, so threads adding
+    // bands to disjoint row ranges need no locks.
+    void add_rows(const film &band, int offset, int first, int last)
+    {
+        first = std::max(first, offset);
+        last = std::min(last, offset + band.h);
+        if (first >= last)
+        {
+            return;
+        }
+        auto n = pixel_count();
+        auto band_n = band.pixel_count();
+        auto count = size_t(last - first) * w;
+        auto summed = has_aovs() ? id_plane() : plane_count(optional);
+        for (size_t c = 0; c < summed; c++)
+        {
+            auto src = band.planes.data() + c * band_n + size_t(first - offset) * w;
+            auto dst = planes.data() + c * n + size_t(first) * w;
+            for (size_t i = 0; i < count; i++)
+            {
+                dst[i] += src[i];
+            }
+        }
+        if (has_aovs())
+        {
+            keep_nearer_ids(band, size_t(first - offset) * w, size_t(first) * w, count);
+        }
+    }
+
+    // Copy of the pixels of `region`, which must lie within the film, with all channels.
+    film crop(const film_region &region) const
+    {
+        film cropped(region.width(), region.height(), optional);
+        auto n = pixel_count();
+        auto cropped_n = cropped.pixel_count();
+        for (int c = 0; c < plane_count(optional); c++)
+        {
+            for (int y = 0; y < region.height(); y++)
+            {
+                auto src = planes.begin() + c * n + size_t(region.y0 + y) * w + region.x0;
+                std::copy(src, src + region.width(), cropped.planes.begin() + c * cropped_n + size_t(y) * cropped.w);
+            }
+        }
+        return cropped;
+    }
+
+    // Plane `c` (0-2 color, 3 weight) of row y.
+    float *row(int c, int y) { return planes.data() + c * pixel_count() + size_t(y) * w; }
+    const float *row(int c, int y) const { return planes.data() + c * pixel_count() + size_t(y) * w; }
+
+    // Weighted average of pixel (x, y); black where nothing was accumulated.
+    color average(int x, int y) const
+    {
+        auto i = size_t(y) * w + x;
+        auto n = pixel_count();
+        auto weight = planes[3 * n + i];
+        if (weight <= 0)
+        {
+            return color::zero();
+        }
+        auto inv = 1.0f / weight;
+        return color(planes[i] * inv, planes[n + i] * inv, planes[2 * n + i] * inv);
+    }
+
+    // Variance of the pixel's mean luminance, exact for unit weight samples; 0 without variance.
+    float variance(int x, int y) const
+    {
+        auto i = size_t(y) * w + x;
+        auto n = pixel_count();
+        auto weight = planes[3 * n + i];
+        if (!has_variance() || weight <= 1)
+        {
+            return 0;
+        }
+        auto mean = luminance(color(planes[i], planes[n + i], planes[2 * n + i])) / weight;
+        auto sample_variance = (planes[PLANES * n + i] - weight * mean * mean) / (weight - 1);
+        return static_cast<float>(fmax(sample_variance, 0.0) / weight);
+    }
+
+    // Average of AOV plane `c` (0 to AOV_PLANES - 1) at pixel (x, y), 0 where nothing was
+    // accumulated; for the two ID planes that follow, the recorded id.
+    float aov(int c, int x, int y) const
+    {
+        auto i = size_t(y) * w + x;
+        auto n = pixel_count();
+        if (c >= AOV_PLANES)
+        {
+            return planes[(id_plane() + 1 + c - AOV_PLANES) * n + i];
+        }
+        auto weight = planes[3 * n + i];
+        return weight > 0 ? planes[(aov_plane() + c) * n + i] / weight : 0.0f;
+    }
+
+    // All planes, for serialization: plane_count(channels()) * pixel_count() floats.
+    float *data() { return planes.data(); }
+    const float *data() const { return planes.data(); }
+    size_t size() const { return planes.size(); }
+
+    size_t heap_bytes() const { return planes.capacity() * sizeof(float); }
+
+private:
+    int w = 0;
+    int h = 0;
+    unsigned optional = 0;
+    std::vector<float> planes;
+
+    size_t aov_plane() const { return PLANES + (has_variance() ? 1 : 0); }
+    size_t id_plane() const { return aov_plane() + AOV_PLANES; }
+
+    // Takes the ids of the `count` pixels of `other` from `from` on where they are nearer than
+    // those of this film's pixels from `to` on; both films have AOVs.
+    void keep_nearer_ids(const film &other, size_t from, size_t to, size_t count)
+    {
+        auto n = pixel_count();
+        auto other_n = other.pixel_count();
+        auto src = other.planes.data() + other.id_plane() * other_n + from;
+        auto dst = planes.data() + id_plane() * n + to;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (src[i] < dst[i])
+            {
+                dst[i] = src[i];
+                dst[n + i] = src[other_n + i];
+                dst[2 * n + i] = src[2 * other_n + i];
+            }
+        }
+    }
+
+    // Copies the planes of `other`, a film of the same size, that this film has too.
+    void copy_planes(const film &other)
+    {
+        auto n = pixel_count();
+        std::copy(other.planes.begin(), other.planes.begin() + PLANES * n, planes.begin());
+        if (has_variance() && other.has_variance())
+        {
+            std::copy_n(other.planes.begin() + PLANES * n, n, planes.begin() + PLANES * n);
+        }
+        if (has_aovs() && other.has_aovs())
+        {
+            std::copy_n(other.planes.begin() + other.aov_plane() * n, (AOV_PLANES + ID_PLANES) * n, planes.begin() + aov_plane() * n);
+        }
+    }
+};
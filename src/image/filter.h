@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cmath>
+#include <string>
+#include "headers.h"
+
+// Pixel reconstruction filters. A camera sample is splatted into every pixel whose center lies
+// within `radius` of it on both axes, weighted by the separable filter. Filters are normalized to
+// integrate to 1, so the weight accumulated per pixel stays close to the sample count.
+enum class filter_kind
+{
+    box,      // radius 0.5: every sample lands in its own pixel only
+    tent,     // radius 1
+    gaussian, // radius 1.5, alpha 2
+    mitchell, // radius 2, B = C = 1/3
+    blackman_harris // radius 2
+};
+
+class reconstruction_filter
+{
+public:
+    reconstruction_filter(filter_kind kind = filter_kind::box);
+
+    // Filter for a -filter name; false if the name is unknown.
+    static bool parse(const std::string &name, reconstruction_filter &filter);
+
+    filter_kind kind() const { return type; }
+    const char *name() const;
+    double radius() const { return extent; }
+
+    // Normalized 1D weight at offset d from the pixel center; weights of the two axes multiply.
+    double weight(double d) const { return normalization * profile(d); }
+
+private:
+    filter_kind type;
+    double extent;
+    double normalization = 1;
+
+    double profile(double d) const;
+};
+
+reconstruction_filter::reconstruction_filter(filter_kind kind) : type(kind)
+{
+    switch (kind)
+    {
+    case filter_kind::box:
+        extent = 0.5;
+        break;
+    case filter_kind::tent:
+        extent = 1;
+        break;
+    case filter_kind::gaussian:
+        extent = 1.5;
+        break;
+    case filter_kind::mitchell:
+    case filter_kind::blackman_harris:
+        extent = 2;
+        break;
+    }
+
+    // Midpoint rule; the profiles are smooth enough that this is exact to well below float noise.
+    const int steps = 4096;
+    double integral = 0;
+    for (int i = 0; i < steps; i++)
+    {
+        integral += profile(-extent + (i + 0.5) * 2 * extent / steps);
+    }
+    normalization = steps / (integral * 2 * extent);
+}
+
+bool reconstruction_filter::parse(const std::string &name, reconstruction_filter &filter)
+{
+    for (auto kind : {filter_kind::box, filter_kind::tent, filter_kind::gaussian, filter_kind::mitchell, filter_kind::blackman_harris})
+    {
+        reconstruction_filter candidate(kind);
+        if (name == candidate.name())
+        {
+            filter = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char *reconstruction_filter::name() const
+{
+    switch (type)
+    {
+    case filter_kind::box:
+        return "box";
+    case filter_kind::tent:
+        return "tent";
+    case filter_kind::gaussian:
+        return "gaussian";
+    case filter_kind::mitchell:
+        return "mitchell";
+    case filter_kind::blackman_harris:
+        return "blackman_harris";
+    }
+    return "";
+}
+
+double reconstruction_filter::profile(double d) const
+{
+    auto x = fabs(d);
+    if (x > extent)
+    {
+        return 0;
+    }
+    switch (type)
+    {
+    case filter_kind::box:
+        return 1;
+    case filter_kind::tent:
+        return 1 - x;
+    case filter_kind::gaussian:
+    {
+        const double alpha = 2;
+        return exp(-alpha * x * x) - exp(-alpha * extent * extent);
+    }
+    case filter_kind::mitchell:
+    {
+        const double b = 1.0 / 3, c = 1.0 / 3;
+        x = 2 * x / extent;
+        if (x > 1)
+        {
+            return ((-b - 6 * c) * x * x * x + (6 * b + 30 * c) * x * x + (-12 * b - 48 * c) * x + (8 * b + 24 * c)) / 6;
+        }
+        return ((12 - 9 * b - 6 * c) * x * x * x + (-18 + 12 * b + 6 * c) * x * x + (6 - 2 * b)) / 6;
+    }
+    case filter_kind::blackman_harris:
+    {
+        auto t = 2 * pi * (d + extent) / (2 * extent);
+        return 0.35875 - 0.48829 * cos(t) + 0.14128 * cos(2 * t) - 0.01168 * cos(3 * t);
+    }
+    }
+    return 0;
+}
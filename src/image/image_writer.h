@@ -0,0 +1,246 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "image/film.h"
+#include "image/parallel.h"
+#include "image/png_encoder.h"
+#include "image/tone_map.h"
+
+enum class image_format
+{
+    ppm, // binary P6
+    png,
+    pfm // 32-bit float RGB, linear
+};
+
+// Format from the extension of `path`; anything unrecognized is written as PPM.
+inline image_format image_format_for(const std::string &path)
+{
+    auto dot = path.find_last_of('.');
+    auto extension = dot == std::string::npos ? std::string() : path.substr(dot + 1);
+    for (auto &c : extension)
+    {
+        c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    if (extension == "png")
+    {
+        return image_format::png;
+    }
+    if (extension == "pfm")
+    {
+        return image_format::pfm;
+    }
+    return image_format::ppm;
+}
+
+// File header of an uncompressed format; PNG has its own and gets an empty string.
+inline std::string image_header(image_format format, int width, int height)
+{
+    auto size = std::to_string(width) + " " + std::to_string(height);
+    switch (format)
+    {
+    case image_format::ppm:
+        return "P6\n" + size + "\n255\n";
+    case image_format::pfm:
+        // A negative scale marks little-endian data.
+        return "PF\n" + size + "\n-1.0\n";
+    default:
+        return std::string();
+    }
+}
+
+// Pixel averages of film row y as PFM data, 3 floats per pixel. PFM stores rows bottom to top,
+// so this is PFM row height - 1 - y.
+inline void resolve_pfm_row(const film &image, int y, float *dst)
+{
+    for (int x = 0; x < image.width(); x++)
+    {
+        auto c = image.average(x, y);
+        dst[3 * x + 0] = static_cast<float>(c.x());
+        dst[3 * x + 1] = static_cast<float>(c.y());
+        dst[3 * x + 2] = static_cast<float>(c.z());
+    }
+}
+
+inline bool write_file(const std::string &path, const std::string &header, const void *data, size_t size)
+{
+    auto file = std::fopen(path.c_str(), "wb");
+    if (file == nullptr)
+    {
+        return false;
+    }
+    auto ok = std::fwrite(header.data(), 1, header.size(), file) == header.size() &&
+              std::fwrite(data, 1, size, file) == size;
+    return std::fclose(file) == 0 && ok;
+}
+
+// Writes the film to `path` in the format given by its extension, encoding on up to `threads`
+// threads. 8-bit formats go through `settings`; PFM holds the linear pixel averages.
+inline bool write_image(const std::string &path, const film &image, const tone_map_settings &settings, int threads)
+{
+    bool ok = false;
+    switch (image_format_for(path))
+    {
+    case image_format::ppm:
+    {
+        auto rgb = tone_map(image, settings, threads);
+        ok = write_file(path, image_header(image_format::ppm, image.width(), image.height()), rgb.data(), rgb.size());
+        break;
+    }
+    case image_format::png:
+    {
+        auto rgb = tone_map(image, settings, threads);
+        auto png = png_encode(rgb.data(), image.width(), image.height(), threads);
+        ok = write_file(path, std::string(), png.data(), png.size());
+        break;
+    }
+    case image_format::pfm:
+    {
+        std::vector<float> pfm(image.pixel_count() * 3);
+        auto resolve_rows = [&](int first, int last)
+        {
+            for (int y = first; y < last; y++)
+            {
+                resolve_pfm_row(image, y, pfm.data() + size_t(image.height() - 1 - y) * image.width() * 3);
+            }
+        };
+        parallel_ranges(image.height(), threads, resolve_rows);
+        ok = write_file(path, image_header(image_format::pfm, image.width(), image.height()), pfm.data(), pfm.size() * sizeof(float));
+        break;
+    }
+    }
+
+    if (!ok)
+    {
+        std::cerr << "ERROR: Could not write image '" << path << "'.\n";
+    }
+    return ok;
+}
+
+// Writes `path` as a copy of `base`, a PPM or PFM image of the full frame_width x frame_height
+// frame in the format of `path`, with the pixels of `region` replaced by `image`, a film of the
+// region's size. Only the region is tone mapped, so the rest of the base image stays byte for
+// byte as it was.
+inline bool composite_image(const std::string &base, const std::string &path, const film &image, const film_region &region,
+                            int frame_width, int frame_height, const tone_map_settings &settings, int threads)
+{
+    auto format = image_format_for(path);
+    std::ifstream in(base, std::ios::binary);
+    std::string magic, scale;
+    int width = 0, height = 0;
+    in >> magic >> width >> height >> scale;
+    in.get();
+    auto expected = format == image_format::pfm ? "PF" : "P6";
+    // Only PFMs in the little-endian byte order this renderer writes are accepted.
+    auto valid = in && format != image_format::png && magic == expected &&
+                 (format != image_format::pfm || std::atof(scale.c_str()) < 0) &&
+                 width == frame_width && height == frame_height;
+    auto channel_bytes = format == image_format::pfm ? sizeof(float) : 1;
+    std::vector<char> pixels(valid ? size_t(width) * height * 3 * channel_bytes : 0);
+    if (!valid || !in.read(pixels.data(), pixels.size()))
+    {
+        std::cerr << "ERROR: Could not read '" << base << "' to composite into; it must be a " << (format == image_format::pfm ? "PFM" : "PPM")
+                  << " image of " << frame_width << "x" << frame_height << ".\n";
+        return false;
+    }
+
+    auto row_bytes = size_t(image.width()) * 3 * channel_bytes;
+    if (format == image_format::pfm)
+    {
+        std::vector<float> row(size_t(image.width()) * 3);
+        for (int y = 0; y < image.height(); y++)
+        {
+            resolve_pfm_row(image, y, row.data());
+            auto dst = pixels.data() + (size_t(height - 1 - region.y0 - y) * width + region.x0) * 3 * channel_bytes;
+            std::memcpy(dst, row.data(), row_bytes);
+        }
+    }
+    else
+    {
+        auto rgb = tone_map(image, settings, threads);
+        for (int y = 0; y < image.height(); y++)
+        {
+            auto dst = pixels.data() + (size_t(region.y0 + y) * width + region.x0) * 3;
+            std::memcpy(dst, rgb.data() + size_t(y) * row_bytes, row_bytes);
+        }
+    }
+    if (!write_file(path, image_header(format, width, height), pixels.data(), pixels.size()))
+    {
+        std::cerr << "ERROR: Could not write image '" << path << "'.\n";
+        return false;
+    }
+    return true;
+}
+
+// Writes the variance of each pixel's mean luminance as a single channel PFM. Films without a
+// variance plane give a black image.
+inline bool write_variance_image(const std::string &path, const film &image, int threads)
+{
+    std::vector<float> flipped(image.pixel_count());
+    auto resolve_rows = [&](int first, int last)
+    {
+        for (int y = first; y < last; y++)
+        {
+            auto dst = flipped.data() + size_t(image.height() - 1 - y) * image.width();
+            for (int x = 0; x < image.width(); x++)
+            {
+                dst[x] = image.variance(x, y);
+            }
+        }
+    };
+    parallel_ranges(image.height(), threads, resolve_rows);
+    auto header = "Pf\n" + std::to_string(image.width()) + " " + std::to_string(image.height()) + "\n-1.0\n";
+    if (!write_file(path, header, flipped.data(), flipped.size() * sizeof(float)))
+    {
+        std::cerr << "ERROR: Could not write image '" << path << "'.\n";
+        return false;
+    }
+    return true;
+}
+
+// Writes each AOV of the film to `<prefix>.<name>.pfm`, with one or three channels.
+inline bool write_aov_images(const std::string &prefix, const film &image, int threads)
+{
+    if (!image.has_aovs())
+    {
+        std::cerr << "ERROR: The film has no AOVs to write to '" << prefix << "'.\n";
+        return false;
+    }
+    auto ok = true;
+    for (const auto &channel : AOV_CHANNELS)
+    {
+        std::vector<float> flipped(image.pixel_count() * channel.planes);
+        auto resolve_rows = [&](int first, int last)
+        {
+            for (int y = first; y < last; y++)
+            {
+                auto dst = flipped.data() + size_t(image.height() - 1 - y) * image.width() * channel.planes;
+                for (int x = 0; x < image.width(); x++)
+                {
+                    for (int c = 0; c < channel.planes; c++)
+                    {
+                        dst[channel.planes * x + c] = image.aov(channel.offset + c, x, y);
+                    }
+                }
+            }
+        };
+        parallel_ranges(image.height(), threads, resolve_rows);
+        auto path = prefix + "." + channel.name + ".pfm";
+        auto header = (channel.planes == 1 ? "Pf\n" : "PF\n") + std::to_string(image.width()) + " " + std::to_string(image.height()) + "\n-1.0\n";
+        if (!write_file(path, header, flipped.data(), flipped.size() * sizeof(float)))
+        {
+            std::cerr << "ERROR: Could not write image '" << path << "'.\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#include "image/film.h"
+#include "image/image_writer.h"
+#include "image/tone_map.h"
+
+// PPM or PFM output file mapped into memory while the render runs. Rows are written into the
+// mapping as they finish, so the file always holds the current state of the render: external
+// viewers can watch it fill in, a crash keeps the finished rows and nothing is left to serialize
+// at the end. Rows may be written from several threads at once as long as they differ.
+class mapped_image
+{
+public:
+    mapped_image() {}
+    mapped_image(const mapped_image &) = delete;
+    mapped_image &operator=(const mapped_image &) = delete;
+    ~mapped_image() { close(); }
+
+    // Creates `path` at its final size; false where the format cannot be streamed (PNG) or the
+    // file cannot be mapped.
+    bool open(const std::string &path, int width, int height, const tone_map_settings &display);
+
+    bool is_open() const { return pixels != nullptr; }
+
+    // Writes rows [first, last) of `image`, which must have the size given to open().
+    void write_rows(const film &image, int first, int last);
+
+    // Flushes the mapping to the file and unmaps it; reports and returns false if that failed.
+    bool close();
+
+private:
+    std::string path;
+    image_format format = image_format::ppm;
+    tone_map_settings settings;
+    uint8_t *mapping = nullptr;
+    uint8_t *pixels = nullptr;
+    size_t mapping_size = 0;
+    size_t row_bytes = 0;
+    int height = 0;
+};
+
+bool mapped_image::open(const std::string &file, int width, int height, const tone_map_settings &display)
+{
+#if defined(_WIN32)
+    return false;
+#else
+    close();
+    format = image_format_for(file);
+    if (format == image_format::png)
+    {
+        return false;
+    }
+    auto header = image_header(format, width, height);
+    row_bytes = size_t(width) * 3 * (format == image_format::pfm ? sizeof(float) : 1);
+    mapping_size = header.size() + row_bytes * height;
+
+    auto fd = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    void *address = MAP_FAILED;
+    if (::ftruncate(fd, static_cast<off_t>(mapping_size)) == 0)
+    {
+        address = ::mmap(nullptr, mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    ::close(fd);
+    if (address == MAP_FAILED)
+    {
+        return false;
+    }
+    mapping = static_cast<uint8_t *>(address);
+    std::memcpy(mapping, header.data(), header.size());
+    pixels = mapping + header.size();
+    path = file;
+    settings = display;
+    this->height = height;
+    return true;
+#endif
+}
+
+void mapped_image::write_rows(const film &image, int first, int last)
+{
+    if (!is_open())
+    {
+        return;
+    }
+    if (format == image_format::ppm)
+    {
+        tone_map_rows(image, settings, first, last, pixels);
+        return;
+    }
+    // The header length leaves PFM data unaligned, so rows are resolved aside and copied in.
+    std::vector<float> row(image.width() * 3);
+    for (int y = first; y < last; y++)
+    {
+        resolve_pfm_row(image, y, row.data());
+        std::memcpy(pixels + size_t(height - 1 - y) * row_bytes, row.data(), row_bytes);
+    }
+}
+
+bool mapped_image::close()
+{
+#if defined(_WIN32)
+    return true;
+#else
+    if (mapping == nullptr)
+    {
+        return true;
+    }
+    auto ok = ::msync(mapping, mapping_size, MS_SYNC) == 0;
+    ok = ::munmap(mapping, mapping_size) == 0 && ok;
+    mapping = nullptr;
+    pixels = nullptr;
+    if (!ok)
+    {
+        std::cerr << "ERROR: Could not write image '" << path << "'.\n";
+    }
+    return ok;
+#endif
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Runs fn(first, last) over [0, count) split into contiguous ranges on up to `threads` threads.
+template <class Fn>
+void parallel_ranges(int count, int threads, Fn fn)
+{
+    threads = std::max(1, std::min(threads, count));
+    std::vector<std::thread> workers;
+    for (int t = 1; t < threads; t++)
+    {
+        workers.emplace_back(fn, int(int64_t(count) * t / threads), int(int64_t(count) * (t + 1) / threads));
+    }
+    fn(0, int(int64_t(count) / threads));
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+}
@@ -0,0 +1,454 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Self-contained PNG encoder for 8-bit RGB images. Rows are split into strips that are filtered
+// and deflated independently on separate threads: every strip restarts the LZ77 window and ends
+// on a byte boundary, so the compressed strips concatenate into one zlib stream, and each is
+// stored as its own IDAT chunk so its CRC is computed by the thread that produced it. Deflate
+// uses the fixed Huffman codes with greedy hash chain matching, which is fast and compresses
+// rendered images to about half of their raw size.
+
+inline uint32_t png_crc32(const uint8_t *data, size_t size, uint32_t crc = 0)
+{
+    static const auto table = []
+    {
+        std::vector<uint32_t> t(256);
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            auto c = n;
+            for (int k = 0; k < 8; k++)
+            {
+                c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            }
+            t[n] = c;
+        }
+        return t;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++)
+    {
+        crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+inline uint32_t png_adler32(const uint8_t *data, size_t size, uint32_t adler = 1)
+{
+    const uint32_t base = 65521;
+    uint32_t a = adler & 0xffff;
+    uint32_t b = adler >> 16;
+    while (size > 0)
+    {
+        // Largest run whose sums cannot overflow before the modulo.
+        auto run = std::min<size_t>(size, 5552);
+        for (size_t i = 0; i < run; i++)
+        {
+            a += data[i];
+            b += a;
+        }
+        a %= base;
+        b %= base;
+        data += run;
+        size -= run;
+    }
+    return (b << 16) | a;
+}
+
+// Adler-32 of the concatenation of two blocks from the checksums of each and the size of the
+// second.
+inline uint32_t png_adler32_combine(uint32_t adler1, uint32_t adler2, size_t size2)
+{
+    const uint32_t base = 65521;
+    auto rem = static_cast<uint32_t>(size2 % base);
+    auto a = adler1 & 0xffff;
+    auto sum1 = a + (adler2 & 0xffff) + base - 1;
+    auto sum2 = static_cast<uint32_t>((uint64_t(rem) * a) % base) + (adler1 >> 16) + (adler2 >> 16) + base - rem;
+    sum1 %= base;
+    sum2 %= base;
+    return (sum2 << 16) | sum1;
+}
+
+// LSB-first bit writer in the order deflate expects.
+class png_bit_writer
+{
+public:
+    std::vector<uint8_t> &out;
+
+    png_bit_writer(std::vector<uint8_t> &out) : out(out) {}
+
+    void bits(uint32_t value, int count)
+    {
+        buffer |= uint64_t(value) << used;
+        used += count;
+        if (used >= 32)
+        {
+            auto size = out.size();
+            out.resize(size + 4);
+            for (int i = 0; i < 4; i++)
+            {
+                out[size + i] = static_cast<uint8_t>(buffer >> (8 * i));
+            }
+            buffer >>= 32;
+            used -= 32;
+        }
+    }
+
+    void align()
+    {
+        while (used > 0)
+        {
+            out.push_back(static_cast<uint8_t>(buffer));
+            buffer >>= 8;
+            used = std::max(0, used - 8);
+        }
+        buffer = 0;
+    }
+
+private:
+    uint64_t buffer = 0;
+    int used = 0;
+};
+
+// Fixed Huffman codes of deflate, bit reversed so they can be written LSB first.
+struct png_fixed_codes
+{
+    uint16_t literal[288];
+    uint8_t literal_bits[288];
+    uint16_t distance[30];
+
+    static const png_fixed_codes &get()
+    {
+        static const png_fixed_codes codes;
+        return codes;
+    }
+
+private:
+    png_fixed_codes()
+    {
+        auto reverse = [](uint32_t value, int count)
+        {
+            uint32_t reversed = 0;
+            for (int i = 0; i < count; i++)
+            {
+                reversed |= ((value >> i) & 1) << (count - 1 - i);
+            }
+            return static_cast<uint16_t>(reversed);
+        };
+        for (int symbol = 0; symbol < 288; symbol++)
+        {
+            uint32_t code;
+            int bits;
+            if (symbol < 144)
+            {
+                code = 0x30 + symbol, bits = 8;
+            }
+            else if (symbol < 256)
+            {
+                code = 0x190 + symbol - 144, bits = 9;
+            }
+            else if (symbol < 280)
+            {
+                code = symbol - 256, bits = 7;
+            }
+            else
+            {
+                code = 0xc0 + symbol - 280, bits = 8;
+            }
+            literal[symbol] = reverse(code, bits);
+            literal_bits[symbol] = static_cast<uint8_t>(bits);
+        }
+        for (int symbol = 0; symbol < 30; symbol++)
+        {
+            distance[symbol] = reverse(symbol, 5);
+        }
+    }
+};
+
+// Deflates `data` as one fixed Huffman block. A block that is not `final` is followed by an empty
+// stored block, which byte-aligns the output so another block can be appended (a zlib sync flush).
+inline void png_deflate(const uint8_t *data, size_t size, bool final, std::vector<uint8_t> &out)
+{
+    static const int length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const int length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const int distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static const int distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+    const size_t window = 32768;
+    const int max_match = 258;
+    const int max_chain = 8;
+    // Positions inside longer matches are not indexed; they rarely start a better match.
+    const int max_insert = 16;
+    const int hash_bits = 15;
+
+    static const auto length_code = []
+    {
+        std::vector<uint8_t> table(max_match + 1);
+        for (int length = 3; length <= max_match; length++)
+        {
+            table[length] = static_cast<uint8_t>(std::upper_bound(length_base, length_base + 29, length) - length_base - 1);
+        }
+        return table;
+    }();
+    auto distance_code = [](int distance)
+    {
+        return static_cast<int>(std::upper_bound(distance_base, distance_base + 30, distance) - distance_base) - 1;
+    };
+
+    const auto &codes = png_fixed_codes::get();
+    out.reserve(out.size() + size / 2 + 64);
+    png_bit_writer writer(out);
+    auto literal = [&](int symbol)
+    {
+        writer.bits(codes.literal[symbol], codes.literal_bits[symbol]);
+    };
+
+    writer.bits(final ? 1 : 0, 1);
+    writer.bits(1, 2);
+
+    std::vector<int32_t> head(size_t(1) << hash_bits, -1);
+    std::vector<int32_t> previous(size);
+    auto hash = [data](size_t i)
+    {
+        return ((uint32_t(data[i]) << 16 | uint32_t(data[i + 1]) << 8 | data[i + 2]) * 2654435761u) >> (32 - hash_bits);
+    };
+    auto insert = [&](size_t i)
+    {
+        auto h = hash(i);
+        previous[i] = head[h];
+        head[h] = static_cast<int32_t>(i);
+    };
+    // Length of the common prefix of data + a and data + b, up to `limit`, eight bytes at a time.
+    auto match_length = [data](size_t a, size_t b, int limit)
+    {
+        int length = 0;
+        while (length + 8 <= limit)
+        {
+            uint64_t x, y;
+            std::memcpy(&x, data + a + length, 8);
+            std::memcpy(&y, data + b + length, 8);
+            if (x != y)
+            {
+                // First differing byte; loads are little-endian on every supported target.
+                auto diff = x ^ y;
+                while ((diff & 0xff) == 0)
+                {
+                    diff >>= 8;
+                    length++;
+                }
+                return length;
+            }
+            length += 8;
+        }
+        while (length < limit && data[a + length] == data[b + length])
+        {
+            length++;
+        }
+        return length;
+    };
+
+    size_t i = 0;
+    while (i < size)
+    {
+        int best_length = 0;
+        int best_distance = 0;
+        if (i + 2 < size)
+        {
+            auto limit = static_cast<int>(std::min<size_t>(max_match, size - i));
+            auto candidate = head[hash(i)];
+            for (int chain = 0; candidate >= 0 && chain < max_chain && i - candidate <= window; chain++)
+            {
+                if (data[candidate + best_length] == data[i + best_length])
+                {
+                    auto length = match_length(candidate, i, limit);
+                    if (length > best_length)
+                    {
+                        best_length = length;
+                        best_distance = static_cast<int>(i - candidate);
+                        if (length == limit)
+                        {
+                            break;
+                        }
+                    }
+                }
+                candidate = previous[candidate];
+            }
+            insert(i);
+        }
+
+        if (best_length >= 3)
+        {
+            auto code = length_code[best_length];
+            literal(257 + code);
+            writer.bits(best_length - length_base[code], length_extra[code]);
+            auto dcode = distance_code(best_distance);
+            writer.bits(codes.distance[dcode], 5);
+            writer.bits(best_distance - distance_base[dcode], distance_extra[dcode]);
+            if (best_length <= max_insert)
+            {
+                for (size_t k = i + 1; k < i + best_length && k + 2 < size; k++)
+                {
+                    insert(k);
+                }
+            }
+            i += best_length;
+        }
+        else
+        {
+            literal(data[i]);
+            i++;
+        }
+    }
+    literal(256);
+
+    if (!final)
+    {
+        writer.bits(0, 3);
+        writer.align();
+        out.insert(out.end(), {0x00, 0x00, 0xff, 0xff});
+    }
+    writer.align();
+}
+
+// Filters rows [first, last) of an RGB image into `out`, one filter type byte per row followed
+// by the filtered row. Each row takes whichever of the five PNG filters gives the smallest sum
+// of absolute residuals.
+inline void png_filter_rows(const uint8_t *rgb, int width, int first, int last, std::vector<uint8_t> &out)
+{
+    const int bpp = 3;
+    auto stride = size_t(width) * bpp;
+    std::vector<uint8_t> zero(stride + bpp, 0);
+    std::vector<uint8_t> padded(stride + bpp, 0);
+    std::vector<uint8_t> padded_above(stride + bpp, 0);
+
+    auto paeth = [](int a, int b, int c)
+    {
+        auto p = a + b - c;
+        auto pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+        return (pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c);
+    };
+    auto cost = [](uint8_t v)
+    {
+        return v < 128 ? uint32_t(v) : uint32_t(256 - v);
+    };
+
+    for (int y = first; y < last; y++)
+    {
+        // Rows with bpp zero bytes in front, so left neighbours need no bounds checks.
+        std::copy(rgb + y * stride, rgb + (y + 1) * stride, padded.begin() + bpp);
+        if (y > 0)
+        {
+            std::copy(rgb + (y - 1) * stride, rgb + y * stride, padded_above.begin() + bpp);
+        }
+        auto row = padded.data() + bpp;
+        auto above = (y > 0 ? padded_above.data() : zero.data()) + bpp;
+
+        uint64_t costs[5] = {0, 0, 0, 0, 0};
+        for (size_t x = 0; x < stride; x++)
+        {
+            int a = row[x - bpp], b = above[x], c = above[x - bpp];
+            costs[0] += cost(row[x]);
+            costs[1] += cost(static_cast<uint8_t>(row[x] - a));
+            costs[2] += cost(static_cast<uint8_t>(row[x] - b));
+            costs[3] += cost(static_cast<uint8_t>(row[x] - (a + b) / 2));
+            costs[4] += cost(static_cast<uint8_t>(row[x] - paeth(a, b, c)));
+        }
+        auto best = static_cast<int>(std::min_element(costs, costs + 5) - costs);
+
+        auto begin = out.size();
+        out.resize(begin + 1 + stride);
+        out[begin] = static_cast<uint8_t>(best);
+        auto dst = out.data() + begin + 1;
+        for (size_t x = 0; x < stride; x++)
+        {
+            int a = row[x - bpp], b = above[x], c = above[x - bpp];
+            int predicted = best == 0 ? 0 : best == 1 ? a : best == 2 ? b : best == 3 ? (a + b) / 2 : paeth(a, b, c);
+            dst[x] = static_cast<uint8_t>(row[x] - predicted);
+        }
+    }
+}
+
+// Appends a chunk of `type` holding `data` to `out`.
+inline void png_chunk(std::vector<uint8_t> &out, const char type[4], const uint8_t *data, size_t size)
+{
+    auto begin = out.size();
+    auto be32 = [&out](uint32_t v)
+    {
+        out.insert(out.end(), {uint8_t(v >> 24), uint8_t(v >> 16), uint8_t(v >> 8), uint8_t(v)});
+    };
+    be32(static_cast<uint32_t>(size));
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    be32(png_crc32(out.data() + begin + 4, size + 4));
+}
+
+// Encodes a top-down 8-bit RGB image into a complete PNG file on up to `threads` threads.
+inline std::vector<uint8_t> png_encode(const uint8_t *rgb, int width, int height, int threads)
+{
+    // Strips are at least 16 rows so the restarted windows cost little ratio.
+    auto strips = std::max(1, std::min(threads, height / 16));
+    struct strip
+    {
+        std::vector<uint8_t> chunk;
+        uint32_t adler = 1;
+        size_t raw = 0;
+    };
+    std::vector<strip> parts(strips);
+
+    auto encode_strip = [&](int s)
+    {
+        auto first = static_cast<int>(int64_t(height) * s / strips);
+        auto last = static_cast<int>(int64_t(height) * (s + 1) / strips);
+        std::vector<uint8_t> filtered;
+        filtered.reserve(size_t(last - first) * (size_t(width) * 3 + 1));
+        png_filter_rows(rgb, width, first, last, filtered);
+        parts[s].raw = filtered.size();
+        parts[s].adler = png_adler32(filtered.data(), filtered.size());
+
+        std::vector<uint8_t> compressed;
+        if (s == 0)
+        {
+            // zlib header: deflate with a 32K window, no dictionary.
+            compressed.insert(compressed.end(), {0x78, 0x01});
+        }
+        png_deflate(filtered.data(), filtered.size(), s == strips - 1, compressed);
+        png_chunk(parts[s].chunk, "IDAT", compressed.data(), compressed.size());
+    };
+
+    std::vector<std::thread> workers;
+    for (int s = 1; s < strips; s++)
+    {
+        workers.emplace_back(encode_strip, s);
+    }
+    encode_strip(0);
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    const uint8_t header[13] = {uint8_t(width >> 24), uint8_t(width >> 16), uint8_t(width >> 8), uint8_t(width),
+                                uint8_t(height >> 24), uint8_t(height >> 16), uint8_t(height >> 8), uint8_t(height),
+                                8, 2, 0, 0, 0};
+    png_chunk(png, "IHDR", header, sizeof(header));
+
+    auto adler = parts[0].adler;
+    for (int s = 0; s < strips; s++)
+    {
+        png.insert(png.end(), parts[s].chunk.begin(), parts[s].chunk.end());
+        if (s > 0)
+        {
+            adler = png_adler32_combine(adler, parts[s].adler, parts[s].raw);
+        }
+    }
+    const uint8_t trailer[4] = {uint8_t(adler >> 24), uint8_t(adler >> 16), uint8_t(adler >> 8), uint8_t(adler)};
+    png_chunk(png, "IDAT", trailer, sizeof(trailer));
+    png_chunk(png, "IEND", nullptr, 0);
+    return png;
+}
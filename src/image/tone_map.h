@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "image/film.h"
+#include "image/parallel.h"
+
+// Display transform applied to a finished film: scale by 2^exposure, gamma encode and quantize to
+// 8 bits. The defaults reproduce the renderer's original gamma 2 output.
+struct tone_map_settings
+{
+    float exposure = 0; // in stops
+    float gamma = 2;
+};
+
+// Tone maps rows [first, last) of `image` into interleaved 8-bit RGB, starting at row `first` of
+// `out`. Rows are processed one plane at a time in simple passes over contiguous floats, which
+// the compiler vectorizes; only the final interleave is scalar.
+inline void tone_map_rows(const film &image, const tone_map_settings &settings, int first, int last, uint8_t *out)
+{
+    auto width = image.width();
+    auto scale = std::exp2(settings.exposure);
+    auto inv_gamma = 1 / settings.gamma;
+    std::vector<float> scaled(width);
+    std::vector<float> channel[3];
+    std::vector<uint8_t> quantized[3];
+    for (int c = 0; c < 3; c++)
+    {
+        channel[c].resize(width);
+        quantized[c].resize(width);
+    }
+
+    for (int y = first; y < last; y++)
+    {
+        // Pixels without samples get an infinite weight and so a zero scale.
+        auto weight = image.row(3, y);
+        for (int x = 0; x < width; x++)
+        {
+            auto w = weight[x] > 0 ? weight[x] : INFINITY;
+            scaled[x] = scale / w;
+        }
+
+        for (int c = 0; c < 3; c++)
+        {
+            auto sum = image.row(c, y);
+            auto v = channel[c].data();
+            for (int x = 0; x < width; x++)
+            {
+                auto linear = sum[x] * scaled[x];
+                v[x] = linear > 0 ? linear : 0.0f;
+            }
+            if (settings.gamma == 2)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    v[x] = std::sqrt(v[x]);
+                }
+            }
+            else if (settings.gamma != 1)
+            {
+                for (int x = 0; x < width; x++)
+                {
+                    v[x] = std::pow(v[x], inv_gamma);
+                }
+            }
+            for (int x = 0; x < width; x++)
+            {
+                v[x] = v[x] < 0.999f ? v[x] : 0.999f;
+            }
+            auto q = quantized[c].data();
+            for (int x = 0; x < width; x++)
+            {
+                q[x] = static_cast<uint8_t>(256 * v[x]);
+            }
+        }
+
+        auto dst = out + size_t(y) * width * 3;
+        for (int x = 0; x < width; x++)
+        {
+            dst[3 * x + 0] = quantized[0][x];
+            dst[3 * x + 1] = quantized[1][x];
+            dst[3 * x + 2] = quantized[2][x];
+        }
+    }
+}
+
+// Tone maps the whole film on up to `threads` threads.
+inline std::vector<uint8_t> tone_map(const film &image, const tone_map_settings &settings, int threads)
+{
+    std::vector<uint8_t> rgb(image.pixel_count() * 3);
+    auto map_rows = [&](int first, int last)
+    {
+        tone_map_rows(image, settings, first, last, rgb.data());
+    };
+    parallel_ranges(image.height(), threads, map_rows);
+    return rgb;
+}
@@ -4,15 +4,17 @@
 #include "material/material.h"
 #include "texture/texture.h"
 #include "texture/solid_color.h"
+#include "texture/texture_program.h"
 
 class diffuse_light : public material
 {
 public:
     shared_ptr<texture> emit;
+    texture_program emit_program;
 
 public:
     diffuse_light(shared_ptr<texture> tex) : emit(tex) {}
-    diffuse_light(color c) : emit(make_shared<solid_color>(c)) {}
+    diffuse_light(color c) : emit(make_scene_object<solid_color>(c)) {}
 
     virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override
     {
@@ -21,6 +23,25 @@ public:
 
     virtual color emitted(double u, double v, const point3 &p) const override
     {
-        return emit->value(u, v, p);
+        if (emit_program.empty())
+        {
+            return emit->value(u, v, p);
+        }
+        return emit_program.evaluate(shading_point{u, v, p, texture_footprint()});
+    }
+
+    virtual void collect_textures(std::vector<const texture *> &out) const override
+    {
+        out.push_back(emit.get());
+    }
+
+    virtual void texture_slots(std::vector<shared_ptr<texture> *> &out) override
+    {
+        out.push_back(&emit);
+    }
+
+    virtual void compile_textures() override
+    {
+        emit_program = texture_program(*emit);
     }
 };
\ No newline at end of file
@@ -3,8 +3,7 @@
 #include <thread>
 #include <chrono>
 #include <atomic>
-#include <mutex>
-#include <semaphore>
+#include <csignal>
 #include "color.h"
 #include "geometry/sphere.h"
 #include "geometry/hittable_list.h"
@@ -13,6 +12,14 @@
 #include "material/metal.h"
 #include "material/dielectric.h"
 #include "scene.h"
+#include "compiled_scene.h"
+#include "texture/texture_baker.h"
+#include "memory/memory_stats.h"
+#include "image/image_writer.h"
+#include "image/checkpoint.h"
+#include "image/mapped_image.h"
+#include "image/denoiser.h"
+#include "image/filter.h"
 #include "cmd/cmd_opts.h"
 
 using namespace std::chrono_literals;
@@ -21,12 +28,22 @@ using namespace std::chrono_literals;
 double aspect_ratio = 3.0 / 2.0;
 int samples_per_pixel = 500;
 const int MAX_DEPTH = 50;
+// Bounces of the paths of -preview images.
+const int PREVIEW_DEPTH = 4;
+// Samples per pixel rendered between two points where a checkpoint can be taken.
+const int PASS_SAMPLES = 16;
 int image_width = 1200;
 int image_height = static_cast<int>(image_width / aspect_ratio);
+bool ray_differentials = false;
 
+std::atomic<int> next_row{0};
 std::atomic<int> progress{0};
-std::mutex m1;
-std::atomic<int> runningThreadCount{0};
+std::atomic<bool> stop_requested{false};
+
+void request_stop(int)
+{
+    stop_requested = true;
+}
 
 color ray_color(const ray &r, const color &background, const hittable &world, int depth)
 {
@@ -52,51 +69,519 @@ color ray_color(const ray &r, const color &background, const hittable &world, in
     return emitted + attenuation * ray_color(scattered, background, world, depth - 1);
 }
 
-// [start, end]
-void scan_vertical(std::vector<rgb> &colors, int start, int end, const color &background, const camera &camera, const hittable &world)
+// Radiance along r like ray_color. `direct` receives the part that was emitted by a light or the
+// background and scattered at most `bounces` times on the way, and `first` the closest hit, with
+// a null mat_ptr if the ray escapes.
+color ray_color_split(const ray &r, const color &background, const hittable &world, int depth, int bounces, color &direct, hit_record &first)
+{
+    direct = color::zero();
+    first.mat_ptr = nullptr;
+    if (depth <= 0)
+    {
+        return color::zero();
+    }
+
+    if (!world.hit(r, 0.001, infinity, first))
+    {
+        first.mat_ptr = nullptr;
+        direct = background;
+        return background;
+    }
+    ray scattered;
+    color attenuation;
+    color emitted = first.mat_ptr->emitted(first.u, first.v, first.p);
+
+    if (!first.mat_ptr->scatter(r, first, attenuation, scattered))
+    {
+        direct = emitted;
+        return emitted;
+    }
+    if (bounces == 0)
+    {
+        direct = emitted;
+        return emitted + attenuation * ray_color(scattered, background, world, depth - 1);
+    }
+    color next_direct;
+    hit_record next;
+    auto incoming = ray_color_split(scattered, background, world, depth - 1, bounces - 1, next_direct, next);
+    direct = emitted + attenuation * next_direct;
+    return emitted + attenuation * incoming;
+}
+
+// Adds the AOVs of one camera sample, laid out as in AOV_CHANNELS, to `sums` and sets its `ids`.
+void accumulate_aovs(const ray &r, const hit_record &first, const color &background, const compiled_scene &world,
+                     const color &radiance, const color &direct, float *sums, sample_ids &ids)
+{
+    auto add3 = [&](int offset, const vec3 &value)
+    {
+        sums[offset] += static_cast<float>(value.x());
+        sums[offset + 1] += static_cast<float>(value.y());
+        sums[offset + 2] += static_cast<float>(value.z());
+    };
+    if (first.mat_ptr == nullptr)
+    {
+        add3(4, background);
+        ids = sample_ids();
+    }
+    else
+    {
+        sums[0] += static_cast<float>((first.p - r.origin()).length());
+        add3(1, first.normal);
+        add3(4, first.mat_ptr->albedo_at(first));
+        ids.material = static_cast<float>(world.material_id(first.mat_ptr));
+        ids.object = static_cast<float>(first.object_id);
+    }
+    add3(7, direct);
+    add3(10, radiance - direct);
+}
+
+// Traces sample `s` of pixel (i, j), with j counted from the bottom row. Returns its radiance
+// and its position (i + sx, j + sy) on the image plane, and adds its AOVs to `aovs` and sets
+// `ids` if given.
+color trace_sample(const render_state &state, int i, int j, int s, const color &background, const camera &camera,
+                   const compiled_scene &world, double &sx, double &sy, float *aovs, sample_ids *ids)
+{
+    // Differentials span one sample's share of a pixel, floored so high sample counts keep
+    // some prefiltering.
+    auto footprint_scale = fmax(0.125, 1 / sqrt(double(samples_per_pixel)));
+    auto ds = footprint_scale / (image_width - 1);
+    auto dt = footprint_scale / (image_height - 1);
+    auto pixel = uint64_t(image_height - 1 - j) * image_width + i;
+    sample_rng rng(state.seed, pixel, s);
+    sample_rng::scope rng_scope(rng);
+    sx = random_double();
+    sy = random_double();
+    auto u = (i + sx) / (image_width - 1);
+    auto v = (j + sy) / (image_height - 1);
+    ray r = ray_differentials ? camera.get_ray(u, v, ds, dt) : camera.get_ray(u, v);
+    if (aovs == nullptr)
+    {
+        return ray_color(r, background, world, MAX_DEPTH);
+    }
+    color direct;
+    hit_record first;
+    auto sample = ray_color_split(r, background, world, MAX_DEPTH, 1, direct, first);
+    accumulate_aovs(r, first, background, world, sample, direct, aovs, *ids);
+    return sample;
+}
+
+// Renders the next `samples` samples of every row of `state` that has exactly `done` samples so
+// far, starting at sample index sample_begin + done, within the region of `state`. Threads take
+// rows from next_row one at a time and add a row to the film only once it is complete, so a stop
+// request leaves every row on a pass boundary. Completed rows are also written to `output` if
+// given.
+void render_pass(render_state &state, int done, int samples, const color &background, const camera &camera, const compiled_scene &world, mapped_image *output)
 {
-    m1.lock();
-    std::cerr << "Scan from " << start << " to " << end << "\n";
-    runningThreadCount++;
-    m1.unlock();
-    for (int j = start; j >= end; --j)
+    auto first_sample = state.sample_begin + done;
+    std::vector<color> row(image_width);
+    std::vector<double> row_squares(image_width);
+    auto aovs = state.image.has_aovs();
+    std::vector<float> row_aovs(aovs ? image_width * film::AOV_PLANES : 0);
+    // Per pixel, the ids of the pass's sample nearest the center and its squared distance.
+    std::vector<sample_ids> row_ids(aovs ? image_width : 0);
+    std::vector<float> row_distances(aovs ? image_width : 0);
+    auto &region = state.region;
+    for (int y = next_row++; y < image_height && !stop_requested; y = next_row++)
     {
-        // std::cerr << "Scanlines remaining: " << j - end << ' ' << std::flush;
-        for (int i = 0; i < image_width; ++i)
+        if (y < region.y0 || y >= region.y1)
+        {
+            continue;
+        }
+        if (state.row_samples[y] != done)
+        {
+            progress--;
+            continue;
+        }
+        auto j = image_height - 1 - y;
+        for (int i = region.x0; i < region.x1; ++i)
         {
             color pixel_color(0, 0, 0);
-            for (int s = 0; s < samples_per_pixel; ++s)
+            double squares = 0;
+            auto pixel_aovs = aovs ? row_aovs.data() + i * film::AOV_PLANES : nullptr;
+            if (aovs)
             {
-                auto u = (i + random_double()) / (image_width - 1);
-                auto v = (j + random_double()) / (image_height - 1);
-                ray r = camera.get_ray(u, v);
-                pixel_color += ray_color(r, background, world, MAX_DEPTH);
+                std::fill(pixel_aovs, pixel_aovs + film::AOV_PLANES, 0.0f);
+                row_distances[i] = std::numeric_limits<float>::infinity();
             }
-
-            write_color(colors, pixel_color, samples_per_pixel);
+            for (int s = first_sample; s < first_sample + samples; ++s)
+            {
+                double sx, sy;
+                sample_ids ids;
+                auto sample = trace_sample(state, i, j, s, background, camera, world, sx, sy, pixel_aovs, &ids);
+                if (aovs)
+                {
+                    auto distance = static_cast<float>((sx - 0.5) * (sx - 0.5) + (sy - 0.5) * (sy - 0.5));
+                    if (distance < row_distances[i])
+                    {
+                        row_distances[i] = distance;
+                        row_ids[i] = ids;
+                    }
+                }
+                pixel_color += sample;
+                squares += luminance(sample) * luminance(sample);
+            }
+            row[i] = pixel_color;
+            row_squares[i] = squares;
+        }
+        if (stop_requested)
+        {
+            break;
+        }
+        for (int i = region.x0; i < region.x1; ++i)
+        {
+            state.image.add(i, y, row[i], samples, row_squares[i]);
+            if (aovs)
+            {
+                state.image.add_aovs(i, y, row_aovs.data() + i * film::AOV_PLANES);
+                state.image.keep_ids(i, y, row_distances[i], row_ids[i]);
+            }
+        }
+        state.row_samples[y] += samples;
+        if (output != nullptr)
+        {
+            output->write_rows(state.image, y, y + 1);
         }
         progress--;
     }
 }
 
+// Film rows per band of a splatting pass.
+const int SPLAT_BAND_ROWS = 16;
+
+// First film row of band `b` of a splatting pass, including the rows its samples spill into.
+int splat_band_offset(int b, int margin)
+{
+    return std::max(0, b * SPLAT_BAND_ROWS - margin);
+}
+
+// Pixels whose samples splat into `region` with a filter reaching `margin` pixels past its own.
+film_region splat_source_region(const film_region &region, int margin)
+{
+    return {std::max(0, region.x0 - margin), std::max(0, region.y0 - margin),
+            std::min(image_width, region.x1 + margin), std::min(image_height, region.y1 + margin)};
+}
+
+// Renders a pass like render_pass, but splats every sample with `filter` into all pixels within
+// its radius. Threads take bands of SPLAT_BAND_ROWS rows from next_row and splat into a film of
+// their own per band that extends `margin` rows past the band on either side; once the pass is
+// complete the bands are added to the image in order, which keeps the result independent of
+// which thread rendered what. A stop request discards the whole pass.
+//
+// Only splats into the region of `state` are kept, but they include those of the pixels within
+// `margin` outside it, so the region comes out exactly as in a full frame render and regions
+// that tile the image merge into it.
+void render_splat_pass(render_state &state, std::vector<film> &bands, const reconstruction_filter &filter, int margin, int done, int samples,
+                       const color &background, const camera &camera, const compiled_scene &world)
+{
+    auto first_sample = state.sample_begin + done;
+    auto aovs = state.image.has_aovs();
+    auto radius = filter.radius();
+    float sample_aovs[film::AOV_PLANES];
+    float splat_aovs[film::AOV_PLANES];
+    double wx[8], wy[8];
+    auto &region = state.region;
+    auto sources = splat_source_region(region, margin);
+    auto band_count = static_cast<int>(bands.size());
+    for (int b = next_row++; b < band_count && !stop_requested; b = next_row++)
+    {
+        auto first = std::max(b * SPLAT_BAND_ROWS, sources.y0);
+        auto last = std::min(std::min((b + 1) * SPLAT_BAND_ROWS, image_height), sources.y1);
+        if (first >= last)
+        {
+            continue;
+        }
+        auto offset = splat_band_offset(b, margin);
+        film band(image_width, std::min((b + 1) * SPLAT_BAND_ROWS + margin, image_height) - offset, state.image.channels());
+        for (int y = first; y < last && !stop_requested; ++y)
+        {
+            auto j = image_height - 1 - y;
+            for (int i = sources.x0; i < sources.x1; ++i)
+            {
+                for (int s = first_sample; s < first_sample + samples; ++s)
+                {
+                    if (aovs)
+                    {
+                        std::fill(sample_aovs, sample_aovs + film::AOV_PLANES, 0.0f);
+                    }
+                    double sx, sy;
+                    sample_ids ids;
+                    auto sample = trace_sample(state, i, j, s, background, camera, world, sx, sy, aovs ? sample_aovs : nullptr, &ids);
+                    auto squared = luminance(sample) * luminance(sample);
+
+                    // Pixels of the region whose centers are within the radius; the center of pixel i
+                    // is at i + 0.5.
+                    auto px = i + sx, py = j + sy;
+                    auto x0 = std::max(region.x0, static_cast<int>(ceil(px - radius - 0.5)));
+                    auto x1 = std::min(region.x1 - 1, static_cast<int>(floor(px + radius - 0.5)));
+                    auto j0 = std::max(image_height - region.y1, static_cast<int>(ceil(py - radius - 0.5)));
+                    auto j1 = std::min(image_height - 1 - region.y0, static_cast<int>(floor(py + radius - 0.5)));
+                    for (int x = x0; x <= x1; ++x)
+                    {
+                        wx[x - x0] = filter.weight(x + 0.5 - px);
+                    }
+                    for (int jj = j0; jj <= j1; ++jj)
+                    {
+                        wy[jj - j0] = filter.weight(jj + 0.5 - py);
+                    }
+                    for (int jj = j0; jj <= j1; ++jj)
+                    {
+                        auto band_y = image_height - 1 - jj - offset;
+                        for (int x = x0; x <= x1; ++x)
+                        {
+                            // IDs are not splatted: each pixel keeps those of the nearest sample
+                            // within the radius.
+                            if (aovs)
+                            {
+                                auto dx = x + 0.5 - px, dy = jj + 0.5 - py;
+                                band.keep_ids(x, band_y, static_cast<float>(dx * dx + dy * dy), ids);
+                            }
+                            auto weight = wx[x - x0] * wy[jj - j0];
+                            if (weight == 0)
+                            {
+                                continue;
+                            }
+                            band.add(x, band_y, weight * sample, weight, weight * squared);
+                            if (aovs)
+                            {
+                                for (int c = 0; c < film::AOV_PLANES; ++c)
+                                {
+                                    splat_aovs[c] = static_cast<float>(weight) * sample_aovs[c];
+                                }
+                                band.add_aovs(x, band_y, splat_aovs);
+                            }
+                        }
+                    }
+                }
+            }
+            progress--;
+        }
+        if (!stop_requested)
+        {
+            bands[b] = std::move(band);
+        }
+    }
+}
+
+// Renders the image at 1/`scale` of its resolution with one sample per pixel and paths of at most
+// `depth` bounces, and returns it at full size with every preview pixel covering a block of
+// pixels. Preview samples draw from streams of their own preview pixels and are thrown away.
+film render_preview(int scale, int depth, uint64_t seed, const color &background, const camera &camera, const compiled_scene &world, int threads)
+{
+    auto w = std::max(2, image_width / scale);
+    auto h = std::max(2, image_height / scale);
+    std::vector<color> pixels(size_t(w) * h);
+    auto render_rows = [&](int first, int last)
+    {
+        for (int y = first; y < last && !stop_requested; ++y)
+        {
+            auto j = h - 1 - y;
+            for (int i = 0; i < w; ++i)
+            {
+                auto pixel = uint64_t(y) * w + i;
+                sample_rng rng(seed, pixel, 0);
+                sample_rng::scope rng_scope(rng);
+                auto u = (i + random_double()) / (w - 1);
+                auto v = (j + random_double()) / (h - 1);
+                pixels[pixel] = ray_color(camera.get_ray(u, v), background, world, depth);
+            }
+        }
+    };
+    parallel_ranges(h, threads, render_rows);
+
+    film preview(image_width, image_height);
+    for (int y = 0; y < image_height; ++y)
+    {
+        auto row = size_t(y) * h / image_height * w;
+        for (int x = 0; x < image_width; ++x)
+        {
+            preview.add(x, y, pixels[row + size_t(x) * w / image_width], 1);
+        }
+    }
+    return preview;
+}
+
+// `Raytracer merge [-image out] [-partial out] [-variance_image out] [-aovs prefix] [-denoise 1]
+// partial...` adds partial renders of the same image, e.g. from workers given different -seed or
+// -sample_range, and writes the result as an image and optionally as a partial render for further
+// merging.
+int merge_partials(int argc, const char *argv[])
+{
+    struct options
+    {
+        string image_output{"image.png"};
+        string partial_output;
+        string variance_output;
+        string aov_output;
+        double exposure{0};
+        double gamma{2};
+        bool denoise{false};
+    };
+
+    auto parser = cmd_opts<options>::create(
+        {{"-image", &options::image_output},
+         {"-partial", &options::partial_output},
+         {"-variance_image", &options::variance_output},
+         {"-aovs", &options::aov_output},
+         {"-denoise", &options::denoise},
+         {"-exposure", &options::exposure},
+         {"-gamma", &options::gamma}});
+    auto configs = parser->parse(argc, argv);
+
+    // Every argument that is neither an option nor an option's value names a partial render.
+    std::vector<std::string> inputs;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (argv[i][0] == '-')
+        {
+            ++i;
+            continue;
+        }
+        inputs.push_back(argv[i]);
+    }
+    if (inputs.empty())
+    {
+        std::cerr << "ERROR: merge needs at least one partial render.\n";
+        return 1;
+    }
+
+    render_state merged;
+    for (size_t k = 0; k < inputs.size(); ++k)
+    {
+        render_state part;
+        if (!part.load(inputs[k]))
+        {
+            std::cerr << "ERROR: Could not read partial render '" << inputs[k] << "'.\n";
+            return 1;
+        }
+        if (k == 0)
+        {
+            merged = std::move(part);
+        }
+        else if (merged.overlaps(part))
+        {
+            std::cerr << "ERROR: Partial render '" << inputs[k] << "' repeats samples already merged: the same -seed, overlapping"
+                      << " -sample_range and overlapping -region; render it with another -seed or -sample_range.\n";
+            return 1;
+        }
+        else if (!merged.merge(part))
+        {
+            std::cerr << "ERROR: Partial render '" << inputs[k] << "' is of a different scene, size or spp, or was rendered with other options, than '" << inputs[0] << "'.\n";
+            return 1;
+        }
+    }
+    std::cerr << "Merged " << inputs.size() << " partial renders of " << merged.scene << "\n";
+
+    int thread_count = std::max(1u, std::thread::hardware_concurrency());
+    if (!configs.partial_output.empty() && !merged.save(configs.partial_output))
+    {
+        std::cerr << "ERROR: Could not write partial render '" << configs.partial_output << "'.\n";
+        return 1;
+    }
+    if (!configs.variance_output.empty() && !write_variance_image(configs.variance_output, merged.image, thread_count))
+    {
+        return 1;
+    }
+    if (!configs.aov_output.empty() && !write_aov_images(configs.aov_output, merged.image, thread_count))
+    {
+        return 1;
+    }
+    tone_map_settings display;
+    display.exposure = static_cast<float>(configs.exposure);
+    display.gamma = static_cast<float>(configs.gamma);
+    if (configs.denoise)
+    {
+        merged.image = denoise(merged.image, denoise_settings(), thread_count);
+    }
+    return write_image(configs.image_output, merged.image, display, thread_count) ? 0 : 1;
+}
+
 #include <Eigen/Dense>
 
 int main(int argc, const char *argv[])
 {
+    if (argc > 1 && std::string(argv[1]) == "merge")
+    {
+        return merge_partials(argc, argv);
+    }
+
     struct options
     {
         string scene_name{"scene"};
         int image_width{1920};
-        string image_output{"image"};
+        string image_output{"image.png"};
+        int samples_per_pixel{0};
+        string stats_output;
+        bool ray_differentials{false};
+        int texture_budget{0};
+        string texture_compression;
+        int bake_textures{0};
+        string bake_cache{"bake_cache"};
+        double exposure{0};
+        double gamma{2};
+        string checkpoint;
+        int checkpoint_interval{0};
+        string resume;
+        int seed{0};
+        string sample_range;
+        string partial_output;
+        bool variance{false};
+        string variance_output;
+        string aov_output;
+        bool denoise{false};
+        string filter{"box"};
+        int preview{0};
+        string region;
+        string composite;
     };
 
     auto parser = cmd_opts<options>::create(
         {{"-scene", &options::scene_name},
          {"-width", &options::image_width},
-         {"-image", &options::image_output}});
+         {"-image", &options::image_output},
+         {"-spp", &options::samples_per_pixel},
+         {"-stats", &options::stats_output},
+         {"-ray_differentials", &options::ray_differentials},
+         {"-texture_budget", &options::texture_budget},
+         {"-texture_compression", &options::texture_compression},
+         {"-bake_textures", &options::bake_textures},
+         {"-bake_cache", &options::bake_cache},
+         {"-exposure", &options::exposure},
+         {"-gamma", &options::gamma},
+         {"-checkpoint", &options::checkpoint},
+         {"-checkpoint_interval", &options::checkpoint_interval},
+         {"-resume", &options::resume},
+         {"-seed", &options::seed},
+         {"-sample_range", &options::sample_range},
+         {"-partial", &options::partial_output},
+         {"-variance", &options::variance},
+         {"-variance_image", &options::variance_output},
+         {"-aovs", &options::aov_output},
+         {"-denoise", &options::denoise},
+         {"-filter", &options::filter},
+         {"-preview", &options::preview},
+         {"-region", &options::region},
+         {"-composite", &options::composite}});
 
     auto configs = parser->parse(argc, argv);
+    reconstruction_filter filter;
+    if (!reconstruction_filter::parse(configs.filter, filter))
+    {
+        std::cerr << "ERROR: Unknown -filter '" << configs.filter << "'; use box, tent, gaussian, mitchell or blackman_harris.\n";
+        return 1;
+    }
+    if (configs.preview < 0 || (configs.preview & (configs.preview - 1)) != 0)
+    {
+        std::cerr << "ERROR: -preview must be a power of two, e.g. 4 or 8.\n";
+        return 1;
+    }
     image_width = configs.image_width;
+    ray_differentials = configs.ray_differentials;
+    if (configs.texture_budget > 0)
+    {
+        // In MiB; bounds the tiles of converted textures held in memory at once.
+        tile_cache::global().set_budget(size_t(configs.texture_budget) << 20);
+    }
+    image_texture::block_compression = configs.texture_compression == "bc1";
     image_height = static_cast<int>(image_width / aspect_ratio);
 
     // World
@@ -106,6 +591,11 @@ int main(int argc, const char *argv[])
     auto aperture = 0.0;
     color background(0, 0, 0);
 
+    // Every scene object created from here on lives in the arena.
+    auto arena = make_shared<scene_arena>();
+    scene_arena::scope arena_scope(*arena);
+    auto build_start = std::chrono::high_resolution_clock::now();
+
     bvh_node world;
     if (configs.scene_name.compare("spheres") == 0)
     {
@@ -182,67 +672,339 @@ int main(int argc, const char *argv[])
         aperture = 0.1;
     }
 
+    if (configs.samples_per_pixel > 0)
+    {
+        samples_per_pixel = configs.samples_per_pixel;
+    }
+
+    compiled_scene scene(world, 0, 1);
+    if (configs.bake_textures > 0)
+    {
+        // Most grid samples along any axis of a primitive's baked texture.
+        bake_procedural_textures(scene, configs.bake_textures, configs.bake_cache, std::max(1u, std::thread::hardware_concurrency()));
+    }
+    scene.compile_textures();
+
+    std::chrono::duration<double> build_time = std::chrono::high_resolution_clock::now() - build_start;
+    std::cerr << "Scene build time: " << build_time.count() << "s\n";
+    arena->report(std::cerr);
+
+    memory_stats stats;
+    stats.scene = configs.scene_name;
+    stats.primitive_objects = arena->bytes(arena_category::primitive);
+    stats.primitive_arrays = scene.primitive_bytes();
+    stats.bvh_objects = arena->bytes(arena_category::bvh);
+    stats.bvh_nodes = scene.bvh_bytes();
+    stats.material_objects = arena->bytes(arena_category::material);
+    stats.material_table = scene.material_table_bytes();
+    stats.texture_objects = arena->bytes(arena_category::texture);
+    for (auto tex : scene.textures())
+    {
+        stats.texture_data += tex->heap_bytes();
+    }
+    stats.arena_reserved = arena->reserved_bytes();
+    stats.peak_rss_build = peak_rss_bytes();
+
     // Camera
     vec3 vup(0, 1, 0);
     auto dist_to_focus = 10;
     camera camera(lookfrom, lookat, vup, vfov, aspect_ratio, aperture, dist_to_focus, 0, 1);
 
-    auto start_time = std::chrono::high_resolution_clock::now();
-
-    int thread_count = std::thread::hardware_concurrency();
-    std::vector<std::thread> threads;
-    std::vector<std::vector<rgb>> final_colors;
-    for (int i = 0; i < thread_count; ++i)
+    // Samples [begin, end) of the image's samples_per_pixel; a worker of a distributed render
+    // renders one range and its partial render is merged with the others.
+    int sample_begin = 0;
+    int sample_end = samples_per_pixel;
+    if (!configs.sample_range.empty() &&
+        (std::sscanf(configs.sample_range.c_str(), "%d,%d", &sample_begin, &sample_end) != 2 ||
+         sample_begin < 0 || sample_end <= sample_begin || sample_end > samples_per_pixel))
     {
-        final_colors.push_back(std::vector<rgb>());
+        std::cerr << "ERROR: -sample_range must be begin,end with 0 <= begin < end <= " << samples_per_pixel << ".\n";
+        return 1;
     }
 
-    progress = image_height;
-
-    int vertical_step = image_height / thread_count;
-    int start = image_height - 1;
-    int end = start - vertical_step;
+    // Pixels to render, rows top to bottom; the rest of the film stays empty. Every pixel draws the
+    // same samples as in a full frame render.
+    film_region region{0, 0, image_width, image_height};
+    if (!configs.region.empty() &&
+        (std::sscanf(configs.region.c_str(), "%d,%d,%d,%d", &region.x0, &region.y0, &region.x1, &region.y1) != 4 ||
+         region.x0 < 0 || region.y0 < 0 || region.x1 <= region.x0 || region.y1 <= region.y0 ||
+         region.x1 > image_width || region.y1 > image_height))
+    {
+        std::cerr << "ERROR: -region must be x0,y0,x1,y1 with 0 <= x0 < x1 <= " << image_width << " and 0 <= y0 < y1 <= "
+                  << image_height << ".\n";
+        return 1;
+    }
+    auto cropped = region != film_region{0, 0, image_width, image_height};
+    if (!configs.composite.empty() && image_format_for(configs.image_output) == image_format::png)
+    {
+        std::cerr << "ERROR: -composite needs a PPM or PFM -image.\n";
+        return 1;
+    }
 
-    for (int i = 0; i < thread_count; ++i)
+    render_state state;
+    state.scene = configs.scene_name;
+    state.samples_per_pixel = samples_per_pixel;
+    state.pass_samples = PASS_SAMPLES;
+    state.sample_begin = sample_begin;
+    state.sample_end = sample_end;
+    state.seed = static_cast<uint64_t>(configs.seed);
+    state.filter = filter.name();
+    state.region = region;
+    state.ray_differentials = configs.ray_differentials;
+    state.texture_compression = configs.texture_compression;
+    state.bake_textures = configs.bake_textures;
+    state.row_samples.assign(image_height, 0);
+    unsigned channels = 0;
+    if (configs.variance || !configs.variance_output.empty())
+    {
+        channels |= film::VARIANCE;
+    }
+    if (!configs.aov_output.empty())
+    {
+        channels |= film::AOVS;
+    }
+    if (configs.denoise)
+    {
+        // The denoiser is guided by the AOVs and the per pixel variance.
+        channels |= film::VARIANCE | film::AOVS;
+    }
+    state.image = film(image_width, image_height, channels);
+    if (!configs.resume.empty())
     {
-        start = image_height - 1 - vertical_step * i;
-        end = start - vertical_step;
-        if (i == thread_count - 1)
+        render_state saved;
+        if (!saved.load(configs.resume))
         {
-            end = 0;
+            std::cerr << "ERROR: Could not read checkpoint '" << configs.resume << "'.\n";
+            return 1;
         }
-        threads.push_back(std::thread(scan_vertical, std::ref(final_colors[i]), start, end, std::ref(background), std::ref(camera), std::ref(world)));
+        if (saved.scene != state.scene || saved.image.width() != image_width || saved.image.height() != image_height ||
+            saved.samples_per_pixel != samples_per_pixel || saved.pass_samples != PASS_SAMPLES ||
+            saved.sample_begin != sample_begin || saved.sample_end != sample_end || saved.seed != state.seed ||
+            !saved.same_options(state) || saved.region != region || saved.image.channels() != channels)
+        {
+            std::cerr << "ERROR: Checkpoint '" << configs.resume << "' is for scene " << saved.scene << " at "
+                      << saved.image.width() << "x" << saved.image.height() << " with " << saved.samples_per_pixel
+                      << " spp, the " << saved.filter << " filter, -ray_differentials " << saved.ray_differentials
+                      << ", -texture_compression '" << saved.texture_compression << "' and -bake_textures "
+                      << saved.bake_textures << "; run with the same options it was started with.\n";
+            return 1;
+        }
+        state = std::move(saved);
+    }
+    auto checkpoint_path = configs.checkpoint;
+    if (checkpoint_path.empty())
+    {
+        checkpoint_path = configs.resume.empty() ? configs.image_output + ".ckpt" : configs.resume;
     }
 
-    while (runningThreadCount != thread_count)
+    auto start_time = std::chrono::high_resolution_clock::now();
+    auto last_checkpoint = start_time;
+
+    int thread_count = std::max(1u, std::thread::hardware_concurrency());
+    auto &image = state.image;
+
+    tone_map_settings display;
+    display.exposure = static_cast<float>(configs.exposure);
+    display.gamma = static_cast<float>(configs.gamma);
+    // PPM and PFM images of the full frame are written while rendering; PNG, cropped and
+    // composited images are encoded once the render is done.
+    mapped_image output;
+    if (!cropped && configs.composite.empty() && output.open(configs.image_output, image_width, image_height, display))
     {
-        std::this_thread::sleep_for(1000ms);
+        output.write_rows(image, 0, image_height);
     }
+    // Writes `result`, a film of the region, as the image: on its own or pasted into -composite.
+    auto write_output = [&](const film &result)
+    {
+        return configs.composite.empty() ? write_image(configs.image_output, result, display, thread_count)
+                                         : composite_image(configs.composite, configs.image_output, result, region, image_width, image_height,
+                                                           display, thread_count);
+    };
+
+    // SIGTERM (preemption) and SIGINT stop the render after the rows in flight and checkpoint it.
+    std::signal(SIGTERM, request_stop);
+    std::signal(SIGINT, request_stop);
 
-    while (progress >= 0)
+    // Preview stages: 1/preview of the resolution, doubled until full size, at 1 spp with short
+    // paths. The passes of the render then refine the full resolution image with more samples.
+    if (configs.preview > 1 && configs.resume.empty())
     {
-        std::cerr << "\rScanlines remainning: " << progress << ' ' << std::flush;
-        std::this_thread::sleep_for(2000ms);
-        if (progress == 0)
+        for (int scale = configs.preview; scale >= 1 && !stop_requested; scale /= 2)
         {
-            break;
+            auto preview_start = std::chrono::high_resolution_clock::now();
+            auto preview = render_preview(scale, PREVIEW_DEPTH, state.seed, background, camera, scene, thread_count);
+            if (stop_requested)
+            {
+                break;
+            }
+            if (output.is_open())
+            {
+                output.write_rows(preview, 0, image_height);
+            }
+            else
+            {
+                write_output(cropped ? preview.crop(region) : preview);
+            }
+            std::chrono::duration<double> preview_time = std::chrono::high_resolution_clock::now() - preview_start;
+            std::cerr << "Preview 1/" << scale << " written in " << preview_time.count() << "s\n";
         }
     }
 
-    for (auto &th : threads)
+    auto range_samples = sample_end - sample_begin;
+    denoise_settings denoising;
+    film denoised;
+    auto passes = (range_samples + PASS_SAMPLES - 1) / PASS_SAMPLES;
+    // The box filter keeps every sample in its own pixel, so rows are rendered straight into the
+    // film; wider filters splat across rows into bands that are added once a pass completes.
+    auto splat = filter.kind() != filter_kind::box;
+    auto splat_margin = static_cast<int>(ceil(filter.radius() + 0.5)) - 1;
+    std::vector<film> bands(splat ? (image_height + SPLAT_BAND_ROWS - 1) / SPLAT_BAND_ROWS : 0);
+    for (int pass = 0; pass < passes && !stop_requested; ++pass)
     {
-        th.join();
+        auto done = pass * PASS_SAMPLES;
+        auto samples = std::min(PASS_SAMPLES, range_samples - done);
+        if (splat && state.row_samples[region.y0] != done)
+        {
+            // Splatting passes complete all rows at once; this one is in the resumed checkpoint.
+            continue;
+        }
+        next_row = 0;
+        progress = splat ? splat_source_region(region, splat_margin).height() : region.height();
+        auto stream = configs.denoise ? nullptr : &output;
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < thread_count; ++i)
+        {
+            if (splat)
+            {
+                threads.push_back(std::thread(render_splat_pass, std::ref(state), std::ref(bands), std::ref(filter), splat_margin, done, samples,
+                                              std::ref(background), std::ref(camera), std::ref(scene)));
+            }
+            else
+            {
+                threads.push_back(std::thread(render_pass, std::ref(state), done, samples, std::ref(background), std::ref(camera), std::ref(scene), stream));
+            }
+        }
+        for (int polls = 0; progress > 0 && !stop_requested; ++polls)
+        {
+            if (polls % 20 == 0)
+            {
+                std::cerr << "\rPass " << pass + 1 << "/" << passes << ", scanlines remaining: " << progress << "    " << std::flush;
+            }
+            std::this_thread::sleep_for(100ms);
+        }
+        for (auto &th : threads)
+        {
+            th.join();
+        }
+        if (splat && !stop_requested)
+        {
+            // Every row gets the bands that overlap it in band order; rows are split among threads.
+            auto add_bands = [&](int first, int last)
+            {
+                for (size_t b = 0; b < bands.size(); ++b)
+                {
+                    image.add_rows(bands[b], splat_band_offset(static_cast<int>(b), splat_margin), first, last);
+                }
+            };
+            parallel_ranges(image_height, thread_count, add_bands);
+            for (int y = region.y0; y < region.y1; ++y)
+            {
+                state.row_samples[y] += samples;
+            }
+            if (stream != nullptr && stream->is_open())
+            {
+                stream->write_rows(image, 0, image_height);
+            }
+        }
+        bands.assign(bands.size(), film());
+        if (configs.denoise && output.is_open() && !stop_requested)
+        {
+            // The streamed image shows the denoised state after every pass instead of noisy rows.
+            denoised = denoise(image, denoising, thread_count);
+            output.write_rows(denoised, 0, image_height);
+        }
+        else if (configs.preview > 1 && !output.is_open() && !stop_requested && pass + 1 < passes)
+        {
+            // Images that are not streamed are rewritten after every pass while previewing.
+            auto result = cropped ? image.crop(region) : image;
+            write_output(configs.denoise ? denoise(result, denoising, thread_count) : result);
+        }
+
+        auto now = std::chrono::high_resolution_clock::now();
+        if (configs.checkpoint_interval > 0 && now - last_checkpoint >= std::chrono::seconds(configs.checkpoint_interval) &&
+            pass + 1 < passes && !stop_requested)
+        {
+            if (!state.save(checkpoint_path))
+            {
+                std::cerr << "\nWARNING: Could not write checkpoint '" << checkpoint_path << "'.\n";
+            }
+            last_checkpoint = now;
+        }
     }
 
-    // Render
-    std::cout << "P3\n"
-              << image_width << " " << image_height << "\n255\n";
-    for (auto &colors : final_colors)
+    if (stop_requested)
     {
-        for (auto &color : colors)
+        if (!state.save(checkpoint_path))
         {
-            std::cout << color.r << ' ' << color.g << ' ' << color.b << '\n';
+            std::cerr << "\nERROR: Render stopped, could not write checkpoint '" << checkpoint_path << "'.\n";
+            return 1;
         }
+        std::cerr << "\nRender stopped; continue it with -resume " << checkpoint_path << "\n";
+        return 1;
+    }
+
+    if (tile_cache::global().misses() > 0)
+    {
+        auto &cache = tile_cache::global();
+        std::cerr << "\nTexture cache: " << cache.used_bytes() << " of " << cache.budget_bytes() << " bytes, "
+                  << cache.hits() << " hits, " << cache.misses() << " misses\n";
+    }
+
+    auto write_start = std::chrono::high_resolution_clock::now();
+    if (!configs.stats_output.empty())
+    {
+        stats.image_width = image_width;
+        stats.image_height = image_height;
+        stats.samples_per_pixel = samples_per_pixel;
+        stats.threads = thread_count;
+        stats.framebuffer = image.heap_bytes();
+        stats.texture_cache = tile_cache::global().used_bytes();
+        stats.peak_rss_render = peak_rss_bytes();
+        stats.write_json(configs.stats_output);
+    }
+    // Everything written from here on covers the region only.
+    film cropped_image;
+    if (cropped)
+    {
+        cropped_image = image.crop(region);
+    }
+    auto &result = cropped ? cropped_image : image;
+    if (configs.denoise && denoised.pixel_count() == 0)
+    {
+        auto denoise_start = std::chrono::high_resolution_clock::now();
+        denoised = denoise(result, denoising, thread_count);
+        std::chrono::duration<double> denoise_time = std::chrono::high_resolution_clock::now() - denoise_start;
+        std::cerr << "\nDenoised in " << denoise_time.count() << "s";
+    }
+    auto &final_image = configs.denoise ? denoised : result;
+    auto written = output.is_open() ? output.close() : write_output(final_image);
+    if (written)
+    {
+        std::chrono::duration<double> write_time = std::chrono::high_resolution_clock::now() - write_start;
+        std::cerr << "\nImage written to " << configs.image_output << " in " << write_time.count() << "s";
+    }
+    if (!configs.variance_output.empty())
+    {
+        write_variance_image(configs.variance_output, result, thread_count);
+    }
+    if (!configs.aov_output.empty())
+    {
+        write_aov_images(configs.aov_output, result, thread_count);
+    }
+    if (!configs.partial_output.empty() && !state.save(configs.partial_output))
+    {
+        std::cerr << "\nERROR: Could not write partial render '" << configs.partial_output << "'.";
     }
     std::cerr << "\nDone.\n";
 
@@ -19,18 +19,18 @@ public:
         double sin_theta = sqrt(1.0 - cos_theta * cos_theta);
 
         bool cannot_refract = refraction_ratio * sin_theta > 1.0;
-        vec3 direction;
 
         if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_double())
         {
-            direction = reflect(unit_direction, rec.normal);
+            scattered = ray(rec.p, reflect(unit_direction, rec.normal), r_in.time());
+            reflect_differentials(r_in, rec, vec3::zero(), scattered);
         }
         else
         {
-            direction = refract(unit_direction, rec.normal, refraction_ratio);
+            scattered = ray(rec.p, refract(unit_direction, rec.normal, refraction_ratio), r_in.time());
+            refract_differentials(r_in, rec, refraction_ratio, scattered);
         }
 
-        scattered = ray(rec.p, direction, r_in.time());
         return true;
     }
 
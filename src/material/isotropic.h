@@ -4,20 +4,49 @@
 #include "material.h"
 #include "texture/texture.h"
 #include "texture/solid_color.h"
+#include "texture/texture_program.h"
 
 class isotropic : public material
 {
 public:
     shared_ptr<texture> albedo;
+    texture_program albedo_program;
 
 public:
-    isotropic(color c) : albedo(make_shared<solid_color>(c)) {}
+    isotropic(color c) : albedo(make_scene_object<solid_color>(c)) {}
     isotropic(shared_ptr<texture> tex) : albedo(tex) {}
 
     virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override
     {
         scattered = ray(rec.p, random_in_unit_sphere(), r_in.time());
-        attenuation = albedo->value(rec.u, rec.v, rec.p);
+        if (albedo_program.empty())
+        {
+            attenuation = albedo->filtered_value(rec.u, rec.v, rec.p, rec.footprint());
+        }
+        else
+        {
+            attenuation = albedo_program.evaluate(shading_point{rec.u, rec.v, rec.p, rec.footprint(), rec.object_id});
+        }
         return true;
     }
+
+    virtual color albedo_at(const hit_record &rec) const override
+    {
+        return albedo->value(rec.u, rec.v, rec.p);
+    }
+
+    virtual void collect_textures(std::vector<const texture *> &out) const override
+    {
+        out.push_back(albedo.get());
+    }
+
+    virtual void texture_slots(std::vector<shared_ptr<texture> *> &out) override
+    {
+        out.push_back(&albedo);
+    }
+
+    virtual void compile_textures() override
+    {
+        albedo_program = texture_program(*albedo);
+    }
 };
\ No newline at end of file
@@ -3,14 +3,16 @@
 #include "material.h"
 #include "headers.h"
 #include "texture/solid_color.h"
+#include "texture/texture_program.h"
 
 class lambertian : public material
 {
 public:
     shared_ptr<texture> albedo;
+    texture_program albedo_program;
 
 public:
-    lambertian(const color &a) : albedo(make_shared<solid_color>(a)) {}
+    lambertian(const color &a) : albedo(make_scene_object<solid_color>(a)) {}
     lambertian(shared_ptr<texture> a) : albedo(a) {}
 
     virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override
@@ -24,8 +26,35 @@ public:
         }
 
         scattered = ray(rec.p, scatter_direction, r_in.time());
-        attenuation = albedo->value(rec.u, rec.v, rec.p);
+        if (albedo_program.empty())
+        {
+            attenuation = albedo->filtered_value(rec.u, rec.v, rec.p, rec.footprint());
+        }
+        else
+        {
+            attenuation = albedo_program.evaluate(shading_point{rec.u, rec.v, rec.p, rec.footprint(), rec.object_id});
+        }
 
         return true;
     }
+
+    virtual color albedo_at(const hit_record &rec) const override
+    {
+        return albedo->value(rec.u, rec.v, rec.p);
+    }
+
+    virtual void collect_textures(std::vector<const texture *> &out) const override
+    {
+        out.push_back(albedo.get());
+    }
+
+    virtual void texture_slots(std::vector<shared_ptr<texture> *> &out) override
+    {
+        out.push_back(&albedo);
+    }
+
+    virtual void compile_textures() override
+    {
+        albedo_program = texture_program(*albedo);
+    }
 };
\ No newline at end of file
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <vector>
 #include "headers.h"
+#include "geometry/hittable.h"
 
-struct hit_record;
+class texture;
 
 class material
 {
@@ -12,4 +14,53 @@ public:
         return color::zero();
     }
     virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const = 0;
-};
\ No newline at end of file
+
+    // Surface color at the hit for the albedo AOV; white for materials without one.
+    virtual color albedo_at(const hit_record &rec) const
+    {
+        return color::identity();
+    }
+
+    // Textures referenced by the material, for scene walks such as memory reports.
+    virtual void collect_textures(std::vector<const texture *> &out) const {}
+
+    // Texture references owned by the material, for scene-load passes that replace textures.
+    virtual void texture_slots(std::vector<shared_ptr<texture> *> &out) {}
+
+    // Flattens the material's texture graphs into texture programs. Called at scene load and
+    // again whenever texture_slots() were replaced; until then lookups go through the textures.
+    virtual void compile_textures() {}
+
+protected:
+    // Carry the differentials of `r_in` over a mirror reflection or a refraction with ratio
+    // `eta` into `scattered`. The change of the normal across the footprint is ignored, so
+    // curved mirrors and lenses under-estimate the spread of the reflected footprint.
+    static void reflect_differentials(const ray &r_in, const hit_record &rec, const vec3 &offset, ray &scattered);
+    static void refract_differentials(const ray &r_in, const hit_record &rec, double eta, ray &scattered);
+};
+
+void material::reflect_differentials(const ray &r_in, const hit_record &rec, const vec3 &offset, ray &scattered)
+{
+    if (!r_in.has_differentials || !rec.has_differentials)
+    {
+        return;
+    }
+    scattered.has_differentials = true;
+    scattered.rx_origin = rec.p + rec.dpdx;
+    scattered.ry_origin = rec.p + rec.dpdy;
+    scattered.rx_direction = reflect(unit_vector(r_in.rx_direction), rec.normal) + offset;
+    scattered.ry_direction = reflect(unit_vector(r_in.ry_direction), rec.normal) + offset;
+}
+
+void material::refract_differentials(const ray &r_in, const hit_record &rec, double eta, ray &scattered)
+{
+    if (!r_in.has_differentials || !rec.has_differentials)
+    {
+        return;
+    }
+    scattered.has_differentials = true;
+    scattered.rx_origin = rec.p + rec.dpdx;
+    scattered.ry_origin = rec.p + rec.dpdy;
+    scattered.rx_direction = refract(unit_vector(r_in.rx_direction), rec.normal, eta);
+    scattered.ry_direction = refract(unit_vector(r_in.ry_direction), rec.normal, eta);
+}
\ No newline at end of file
@@ -14,9 +14,16 @@ public:
     virtual bool scatter(const ray &r_in, const hit_record &rec, color &attenuation, ray &scattered) const override
     {
         vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-        scattered = ray(rec.p, reflected + fuzz * random_in_unit_sphere(), r_in.time());
+        vec3 offset = fuzz * random_in_unit_sphere();
+        scattered = ray(rec.p, reflected + offset, r_in.time());
+        reflect_differentials(r_in, rec, offset, scattered);
         attenuation = albedo;
 
         return dot(scattered.direction(), rec.normal) > 0;
     }
+
+    virtual color albedo_at(const hit_record &rec) const override
+    {
+        return albedo;
+    }
 };
\ No newline at end of file
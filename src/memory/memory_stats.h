@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <string>
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+// Peak resident set size of the process so far, in bytes (0 where unsupported).
+inline size_t peak_rss_bytes()
+{
+#if defined(_WIN32)
+    return 0;
+#else
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+// Memory report of one render, written as JSON for capacity planning.
+struct memory_stats
+{
+    std::string scene;
+    int image_width = 0;
+    int image_height = 0;
+    int samples_per_pixel = 0;
+    int threads = 0;
+
+    size_t primitive_objects = 0; // scene-building objects in the arena
+    size_t primitive_arrays = 0;  // compiled typed arrays and primitive-owned heap
+    size_t bvh_objects = 0;       // bvh_node objects from scene building
+    size_t bvh_nodes = 0;         // compiled BVH nodes and leaf ranges
+    size_t material_objects = 0;
+    size_t material_table = 0;
+    size_t texture_objects = 0;
+    size_t texture_data = 0;   // decoded images, noise tables
+    size_t texture_cache = 0;  // tiles of converted textures resident at the end of the render
+    size_t framebuffer = 0;    // accumulation film shared by the render threads
+    size_t arena_reserved = 0;
+
+    size_t peak_rss_build = 0;
+    size_t peak_rss_render = 0;
+
+    void write_json(std::ostream &out) const;
+    bool write_json(const std::string &path) const;
+};
+
+void memory_stats::write_json(std::ostream &out) const
+{
+    auto primitives = primitive_objects + primitive_arrays;
+    auto bvh = bvh_objects + bvh_nodes;
+    auto materials = material_objects + material_table;
+    auto textures = texture_objects + texture_data + texture_cache;
+    auto total = primitives + bvh + materials + textures + framebuffer;
+
+    out << "{\n"
+        << "  \"scene\": \"" << scene << "\",\n"
+        << "  \"image\": {\"width\": " << image_width << ", \"height\": " << image_height
+        << ", \"samples_per_pixel\": " << samples_per_pixel << ", \"threads\": " << threads << "},\n"
+        << "  \"bytes\": {\n"
+        << "    \"primitives\": {\"total\": " << primitives << ", \"objects\": " << primitive_objects << ", \"arrays\": " << primitive_arrays << "},\n"
+        << "    \"bvh\": {\"total\": " << bvh << ", \"objects\": " << bvh_objects << ", \"nodes\": " << bvh_nodes << "},\n"
+        << "    \"materials\": {\"total\": " << materials << ", \"objects\": " << material_objects << ", \"table\": " << material_table << "},\n"
+        << "    \"textures\": {\"total\": " << textures << ", \"objects\": " << texture_objects << ", \"data\": " << texture_data << ", \"cache\": " << texture_cache << "},\n"
+        << "    \"framebuffer\": " << framebuffer << ",\n"
+        << "    \"arena_reserved\": " << arena_reserved << ",\n"
+        << "    \"total\": " << total << "\n"
+        << "  },\n"
+        << "  \"peak_rss_bytes\": {\"build\": " << peak_rss_build << ", \"render\": " << peak_rss_render << "}\n"
+        << "}\n";
+}
+
+bool memory_stats::write_json(const std::string &path) const
+{
+    std::ofstream out(path);
+    if (!out)
+    {
+        std::cerr << "ERROR: Could not write memory stats to '" << path << "'.\n";
+        return false;
+    }
+    write_json(out);
+    return true;
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using std::shared_ptr;
+
+class hittable;
+class bvh_node;
+class material;
+class texture;
+
+enum class arena_category
+{
+    primitive,
+    bvh,
+    material,
+    texture,
+    other,
+    count
+};
+
+inline const char *arena_category_name(arena_category category)
+{
+    switch (category)
+    {
+    case arena_category::primitive:
+        return "primitives";
+    case arena_category::bvh:
+        return "bvh";
+    case arena_category::material:
+        return "materials";
+    case arena_category::texture:
+        return "textures";
+    default:
+        return "other";
+    }
+}
+
+template <class T>
+constexpr arena_category arena_category_of()
+{
+    if constexpr (std::is_base_of_v<bvh_node, T>)
+    {
+        return arena_category::bvh;
+    }
+    else if constexpr (std::is_base_of_v<hittable, T>)
+    {
+        return arena_category::primitive;
+    }
+    else if constexpr (std::is_base_of_v<material, T>)
+    {
+        return arena_category::material;
+    }
+    else if constexpr (std::is_base_of_v<texture, T>)
+    {
+        return arena_category::texture;
+    }
+    else
+    {
+        return arena_category::other;
+    }
+}
+
+template <class T>
+class arena_allocator;
+
+// Bump allocator that owns the objects of a scene for the lifetime of the render. Objects are
+// placed in large blocks in creation order, so a primitive sits next to the material and
+// texture created with it, and all blocks are released together once the last object (and
+// the arena handle) is gone. Not thread safe: scenes are built on a single thread.
+class scene_arena : public std::enable_shared_from_this<scene_arena>
+{
+public:
+    static const size_t BLOCK_SIZE = 1 << 20;
+
+    // Makes `arena` the target of make_scene_object() on this thread while in scope.
+    class scope
+    {
+    public:
+        scope(scene_arena &arena) : previous(current_arena())
+        {
+            current_arena() = &arena;
+        }
+        ~scope()
+        {
+            current_arena() = previous;
+        }
+
+    private:
+        scene_arena *previous;
+    };
+
+public:
+    scene_arena() {}
+    scene_arena(const scene_arena &) = delete;
+    scene_arena &operator=(const scene_arena &) = delete;
+
+    static scene_arena *current() { return current_arena(); }
+
+    void *allocate(size_t bytes, size_t alignment, arena_category category);
+
+    template <class T, class... Args>
+    shared_ptr<T> make(Args &&...args);
+
+    size_t bytes(arena_category category) const { return category_bytes[static_cast<int>(category)]; }
+    size_t used_bytes() const;
+    size_t reserved_bytes() const { return reserved; }
+
+    void report(std::ostream &out) const;
+
+private:
+    std::vector<std::unique_ptr<unsigned char[]>> blocks;
+    unsigned char *cursor = nullptr;
+    size_t remaining = 0;
+    size_t reserved = 0;
+    size_t category_bytes[static_cast<int>(arena_category::count)] = {};
+
+    static scene_arena *&current_arena()
+    {
+        static thread_local scene_arena *arena = nullptr;
+        return arena;
+    }
+};
+
+// Allocator handed to allocate_shared. It keeps the arena alive for as long as any object
+// (and its control block) placed in it exists; deallocation is a no-op.
+template <class T>
+class arena_allocator
+{
+public:
+    using value_type = T;
+
+    shared_ptr<scene_arena> arena;
+    arena_category category;
+
+public:
+    arena_allocator(shared_ptr<scene_arena> arena, arena_category category) : arena(std::move(arena)), category(category) {}
+
+    template <class U>
+    arena_allocator(const arena_allocator<U> &other) : arena(other.arena), category(other.category) {}
+
+    T *allocate(size_t n)
+    {
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T), category));
+    }
+
+    void deallocate(T *, size_t) {}
+
+    template <class U>
+    bool operator==(const arena_allocator<U> &other) const { return arena == other.arena; }
+
+    template <class U>
+    bool operator!=(const arena_allocator<U> &other) const { return arena != other.arena; }
+};
+
+void *scene_arena::allocate(size_t bytes, size_t alignment, arena_category category)
+{
+    auto padding = (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment;
+    if (cursor == nullptr || padding + bytes > remaining)
+    {
+        auto size = bytes + alignment > BLOCK_SIZE ? bytes + alignment : BLOCK_SIZE;
+        blocks.emplace_back(new unsigned char[size]);
+        cursor = blocks.back().get();
+        remaining = size;
+        reserved += size;
+        padding = (alignment - reinterpret_cast<uintptr_t>(cursor) % alignment) % alignment;
+    }
+
+    auto result = cursor + padding;
+    cursor += padding + bytes;
+    remaining -= padding + bytes;
+    category_bytes[static_cast<int>(category)] += bytes;
+    return result;
+}
+
+template <class T, class... Args>
+shared_ptr<T> scene_arena::make(Args &&...args)
+{
+    return std::allocate_shared<T>(arena_allocator<T>(shared_from_this(), arena_category_of<T>()), std::forward<Args>(args)...);
+}
+
+size_t scene_arena::used_bytes() const
+{
+    size_t total = 0;
+    for (auto bytes : category_bytes)
+    {
+        total += bytes;
+    }
+    return total;
+}
+
+void scene_arena::report(std::ostream &out) const
+{
+    out << "Scene arena: " << used_bytes() << " bytes used, " << reserved << " reserved in " << blocks.size() << " blocks\n";
+    for (int i = 0; i < static_cast<int>(arena_category::count); i++)
+    {
+        out << "  " << arena_category_name(static_cast<arena_category>(i)) << ": " << category_bytes[i] << " bytes\n";
+    }
+}
+
+// Creates a scene object in the arena that is current on this thread, or on the heap when
+// no arena is active.
+template <class T, class... Args>
+shared_ptr<T> make_scene_object(Args &&...args)
+{
+    if (auto arena = scene_arena::current())
+    {
+        return arena->make<T>(std::forward<Args>(args)...);
+    }
+    return std::make_shared<T>(std::forward<Args>(args)...);
+}
@@ -1,15 +1,25 @@
 #pragma once
 
+#include <cstdint>
 #include "headers.h"
 
+// Gradient noise. noise() and turb_reference() are the straightforward scalar versions; turb()
+// evaluates all octaves at once as fixed-width lanes over int32 permutation tables and float
+// gradients in SoA layout, which the compiler turns into SIMD code.
 class perlin
 {
+public:
+    static const int OCTAVE_LANES = 8;
+
 private:
     static const int POINT_COUNT = 256;
     vec3 *ranvec;
-    int *perm_x;
-    int *perm_y;
-    int *perm_z;
+    int32_t *perm_x;
+    int32_t *perm_y;
+    int32_t *perm_z;
+    float *grad_x;
+    float *grad_y;
+    float *grad_z;
 
 public:
     perlin()
@@ -23,6 +33,16 @@ public:
         perm_x = perlin_generate_perm();
         perm_y = perlin_generate_perm();
         perm_z = perlin_generate_perm();
+
+        grad_x = new float[POINT_COUNT];
+        grad_y = new float[POINT_COUNT];
+        grad_z = new float[POINT_COUNT];
+        for (int i = 0; i < POINT_COUNT; i++)
+        {
+            grad_x[i] = static_cast<float>(ranvec[i].x());
+            grad_y[i] = static_cast<float>(ranvec[i].y());
+            grad_z[i] = static_cast<float>(ranvec[i].z());
+        }
     }
 
     ~perlin()
@@ -31,6 +51,9 @@ public:
         delete[] perm_x;
         delete[] perm_y;
         delete[] perm_z;
+        delete[] grad_x;
+        delete[] grad_y;
+        delete[] grad_z;
     }
 
     double noise(const point3 &p) const
@@ -54,7 +77,49 @@ public:
         return perlin_interp(c, u, v, w);
     }
 
-    double turb(const point3& p, int depth=7) const {
+    size_t heap_bytes() const
+    {
+        return POINT_COUNT * (sizeof(vec3) + 3 * sizeof(int32_t) + 3 * sizeof(float));
+    }
+
+    // Turbulence of up to OCTAVE_LANES octaves, one octave per lane. Lattice coordinates are
+    // split in double precision so far away points keep their fractional detail.
+    double turb(const point3 &p, int depth = 7) const
+    {
+        if (depth > OCTAVE_LANES)
+        {
+            return turb_reference(p, depth);
+        }
+
+        double x[OCTAVE_LANES], y[OCTAVE_LANES], z[OCTAVE_LANES];
+        float weight[OCTAVE_LANES];
+        for (int o = 0; o < OCTAVE_LANES; o++)
+        {
+            auto frequency = double(1 << o);
+            x[o] = p.x() * frequency;
+            y[o] = p.y() * frequency;
+            z[o] = p.z() * frequency;
+            weight[o] = o < depth ? 1.0f / (1 << o) : 0.0f;
+        }
+
+        int32_t xi[OCTAVE_LANES], yi[OCTAVE_LANES], zi[OCTAVE_LANES];
+        float u[OCTAVE_LANES], v[OCTAVE_LANES], w[OCTAVE_LANES];
+        split(x, xi, u);
+        split(y, yi, v);
+        split(z, zi, w);
+
+        float octaves[OCTAVE_LANES];
+        noise_lanes(xi, yi, zi, u, v, w, octaves);
+
+        auto accum = 0.0f;
+        for (int o = 0; o < OCTAVE_LANES; o++)
+        {
+            accum += weight[o] * octaves[o];
+        }
+        return fabs(accum);
+    }
+
+    double turb_reference(const point3& p, int depth=7) const {
         auto accum = 0.0;
         auto temp_p = p;
         auto weight = 1.0;
@@ -69,9 +134,72 @@ public:
     }
 
 private:
-    static int *perlin_generate_perm()
+    // Lattice cell (wrapped to the table size) and offset inside it, per lane.
+    static void split(const double *x, int32_t *cell, float *fraction)
+    {
+        for (int l = 0; l < OCTAVE_LANES; l++)
+        {
+            // Truncate and step down for negatives: a floor that vectorizes without SSE4.1.
+            auto truncated = static_cast<int32_t>(x[l]);
+            auto floor_x = truncated - (x[l] < truncated ? 1 : 0);
+            cell[l] = floor_x & 255;
+            fraction[l] = static_cast<float>(x[l] - floor_x);
+        }
+    }
+
+    // Noise at OCTAVE_LANES lattice cells and offsets. The corner hashes and gradients are
+    // gathered first; the gradient dots and the smoothstep-weighted trilinear blend, fused
+    // into lerps, then run as one branch-free loop over the lanes.
+    void noise_lanes(const int32_t *xi, const int32_t *yi, const int32_t *zi,
+                     const float *u, const float *v, const float *w, float *out) const
+    {
+        // Corner c = 4 * dx + 2 * dy + dz.
+        float gx[8][OCTAVE_LANES], gy[8][OCTAVE_LANES], gz[8][OCTAVE_LANES];
+        for (int l = 0; l < OCTAVE_LANES; l++)
+        {
+            int32_t hx[2] = {perm_x[xi[l]], perm_x[(xi[l] + 1) & 255]};
+            int32_t hy[2] = {perm_y[yi[l]], perm_y[(yi[l] + 1) & 255]};
+            int32_t hz[2] = {perm_z[zi[l]], perm_z[(zi[l] + 1) & 255]};
+            for (int c = 0; c < 8; c++)
+            {
+                auto h = hx[c >> 2] ^ hy[(c >> 1) & 1] ^ hz[c & 1];
+                gx[c][l] = grad_x[h];
+                gy[c][l] = grad_y[h];
+                gz[c][l] = grad_z[h];
+            }
+        }
+
+        for (int l = 0; l < OCTAVE_LANES; l++)
+        {
+            auto fx0 = u[l], fy0 = v[l], fz0 = w[l];
+            auto fx1 = fx0 - 1, fy1 = fy0 - 1, fz1 = fz0 - 1;
+
+            auto n000 = gx[0][l] * fx0 + gy[0][l] * fy0 + gz[0][l] * fz0;
+            auto n001 = gx[1][l] * fx0 + gy[1][l] * fy0 + gz[1][l] * fz1;
+            auto n010 = gx[2][l] * fx0 + gy[2][l] * fy1 + gz[2][l] * fz0;
+            auto n011 = gx[3][l] * fx0 + gy[3][l] * fy1 + gz[3][l] * fz1;
+            auto n100 = gx[4][l] * fx1 + gy[4][l] * fy0 + gz[4][l] * fz0;
+            auto n101 = gx[5][l] * fx1 + gy[5][l] * fy0 + gz[5][l] * fz1;
+            auto n110 = gx[6][l] * fx1 + gy[6][l] * fy1 + gz[6][l] * fz0;
+            auto n111 = gx[7][l] * fx1 + gy[7][l] * fy1 + gz[7][l] * fz1;
+
+            auto su = fx0 * fx0 * (3 - 2 * fx0);
+            auto sv = fy0 * fy0 * (3 - 2 * fy0);
+            auto sw = fz0 * fz0 * (3 - 2 * fz0);
+
+            auto n00 = n000 + sw * (n001 - n000);
+            auto n01 = n010 + sw * (n011 - n010);
+            auto n10 = n100 + sw * (n101 - n100);
+            auto n11 = n110 + sw * (n111 - n110);
+            auto n0 = n00 + sv * (n01 - n00);
+            auto n1 = n10 + sv * (n11 - n10);
+            out[l] = n0 + su * (n1 - n0);
+        }
+    }
+
+    static int32_t *perlin_generate_perm()
     {
-        auto p = new int[POINT_COUNT];
+        auto p = new int32_t[POINT_COUNT];
         for (int i = 0; i < POINT_COUNT; i++)
         {
             p[i] = i;
@@ -81,7 +209,7 @@ private:
         return p;
     }
 
-    static void permute(int *p, int n)
+    static void permute(int32_t *p, int n)
     {
         for (int i = n - 1; i > 0; i--)
         {
@@ -2,23 +2,32 @@
 
 #include "vec3.h"
 
-class ray
+template <class T>
+class ray_t
 {
 public:
-    point3 orig;
-    vec3 dir;
-    double tm;
+    vec3_t<T> orig;
+    vec3_t<T> dir;
+    T tm;
+
+    // Optional differentials: the rays through the neighbouring pixels in x and y, used to
+    // estimate texture footprints. Only valid when has_differentials is set.
+    bool has_differentials = false;
+    vec3_t<T> rx_origin, rx_direction;
+    vec3_t<T> ry_origin, ry_direction;
 
 public:
-    ray() {}
-    ray(const point3 &origin, const vec3 &direction, double time = 0.0) : orig(origin), dir(direction), tm(time) {}
+    ray_t() {}
+    ray_t(const vec3_t<T> &origin, const vec3_t<T> &direction, T time = 0) : orig(origin), dir(direction), tm(time) {}
 
-    point3 origin() const { return orig; }
-    vec3 direction() const { return dir; }
-    double time() const { return tm; }
+    vec3_t<T> origin() const { return orig; }
+    vec3_t<T> direction() const { return dir; }
+    T time() const { return tm; }
 
-    point3 at(double t) const
+    vec3_t<T> at(T t) const
     {
         return orig + t * dir;
     }
-};
\ No newline at end of file
+};
+
+using ray = ray_t<real>;
@@ -1,10 +0,0 @@
-#pragma once
-
-struct rgb
-{
-    int r;
-    int g;
-    int b;
-
-    rgb(int r, int g, int b) : r(r), g(g), b(b) {}
-};
\ No newline at end of file
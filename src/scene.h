@@ -6,7 +6,9 @@
 #include "geometry/box.h"
 #include "geometry/translate.h"
 #include "geometry/rotate_y.h"
+#include "geometry/transform_instance.h"
 #include "geometry/constant_medium.h"
+#include "geometry/sphere_set.h"
 #include "bvh_node.h"
 #include "texture/checker_texture.h"
 #include "texture/noise_texture.h"
@@ -17,9 +19,9 @@ bvh_node random_scene()
 {
     hittable_list objects;
 
-    // auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
-    auto checker = make_shared<checker_texture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
-    objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(checker)));
+    // auto ground_material = make_scene_object<lambertian>(color(0.5, 0.5, 0.5));
+    auto checker = make_scene_object<checker_texture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+    objects.add(make_scene_object<sphere>(point3(0, -1000, 0), 1000, make_scene_object<lambertian>(checker)));
 
     for (int a = -11; a < 11; a++)
     {
@@ -36,36 +38,36 @@ bvh_node random_scene()
                 {
                     // diffuse
                     auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
+                    sphere_material = make_scene_object<lambertian>(albedo);
                     auto center2 = center + vec3(0, random_double(0, 0.5), 0);
-                    objects.add(make_shared<moving_sphere>(center, center2, 0, 1, 0.2, sphere_material));
+                    objects.add(make_scene_object<moving_sphere>(center, center2, 0, 1, 0.2, sphere_material));
                 }
                 else if (choose_mat < 0.95)
                 {
                     // metal
                     auto albedo = color::random(0.5, 1);
                     auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    objects.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    sphere_material = make_scene_object<metal>(albedo, fuzz);
+                    objects.add(make_scene_object<sphere>(center, 0.2, sphere_material));
                 }
                 else
                 {
                     // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    objects.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    sphere_material = make_scene_object<dielectric>(1.5);
+                    objects.add(make_scene_object<sphere>(center, 0.2, sphere_material));
                 }
             }
         }
     }
 
-    auto material1 = make_shared<dielectric>(1.5);
-    objects.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
+    auto material1 = make_scene_object<dielectric>(1.5);
+    objects.add(make_scene_object<sphere>(point3(0, 1, 0), 1.0, material1));
 
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
-    objects.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
+    auto material2 = make_scene_object<lambertian>(color(0.4, 0.2, 0.1));
+    objects.add(make_scene_object<sphere>(point3(-4, 1, 0), 1.0, material2));
 
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
-    objects.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
+    auto material3 = make_scene_object<metal>(color(0.7, 0.6, 0.5), 0.0);
+    objects.add(make_scene_object<sphere>(point3(4, 1, 0), 1.0, material3));
 
     bvh_node world(objects, 0, 1);
 
@@ -76,10 +78,10 @@ bvh_node two_spheres()
 {
     hittable_list objects;
 
-    auto checker = make_shared<checker_texture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
+    auto checker = make_scene_object<checker_texture>(color(0.2, 0.3, 0.1), color(0.9, 0.9, 0.9));
 
-    objects.add(make_shared<sphere>(point3(0, -10, 0), 10, make_shared<lambertian>(checker)));
-    objects.add(make_shared<sphere>(point3(0, 10, 0), 10, make_shared<lambertian>(checker)));
+    objects.add(make_scene_object<sphere>(point3(0, -10, 0), 10, make_scene_object<lambertian>(checker)));
+    objects.add(make_scene_object<sphere>(point3(0, 10, 0), 10, make_scene_object<lambertian>(checker)));
 
     bvh_node world(objects, 0, 1);
     return world;
@@ -89,9 +91,9 @@ bvh_node two_perlin_spheres()
 {
     hittable_list objects;
 
-    auto pertext = make_shared<noise_texture>(4);
-    objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
-    objects.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
+    auto pertext = make_scene_object<noise_texture>(4);
+    objects.add(make_scene_object<sphere>(point3(0, -1000, 0), 1000, make_scene_object<lambertian>(pertext)));
+    objects.add(make_scene_object<sphere>(point3(0, 2, 0), 2, make_scene_object<lambertian>(pertext)));
 
     bvh_node world(objects, 0, 1);
     return world;
@@ -99,9 +101,9 @@ bvh_node two_perlin_spheres()
 
 bvh_node earth()
 {
-    auto earth_texture = make_shared<image_texture>("../assets/earthmap.jpeg");
-    auto earth_surface = make_shared<lambertian>(earth_texture);
-    auto globe = make_shared<sphere>(point3(0, 0, 0), 2, earth_surface);
+    auto earth_texture = make_scene_object<image_texture>("../assets/earthmap.jpeg");
+    auto earth_surface = make_scene_object<lambertian>(earth_texture);
+    auto globe = make_scene_object<sphere>(point3(0, 0, 0), 2, earth_surface);
 
     bvh_node world(hittable_list(globe), 0, 1);
     return world;
@@ -111,12 +113,12 @@ bvh_node simple_light()
 {
     hittable_list objects;
 
-    auto pertext = make_shared<noise_texture>(4);
-    objects.add(make_shared<sphere>(point3(0, -1000, 0), 1000, make_shared<lambertian>(pertext)));
-    objects.add(make_shared<sphere>(point3(0, 2, 0), 2, make_shared<lambertian>(pertext)));
+    auto pertext = make_scene_object<noise_texture>(4);
+    objects.add(make_scene_object<sphere>(point3(0, -1000, 0), 1000, make_scene_object<lambertian>(pertext)));
+    objects.add(make_scene_object<sphere>(point3(0, 2, 0), 2, make_scene_object<lambertian>(pertext)));
 
-    auto difflight = make_shared<diffuse_light>(color(4, 4, 4));
-    objects.add(make_shared<xy_rect>(3, 5, 1, 3, -2, difflight));
+    auto difflight = make_scene_object<diffuse_light>(color(4, 4, 4));
+    objects.add(make_scene_object<xy_rect>(3, 5, 1, 3, -2, difflight));
 
     bvh_node world(objects, 0, 1);
     return world;
@@ -126,26 +128,26 @@ bvh_node cornell_box()
 {
     hittable_list objects;
 
-    auto red = make_shared<lambertian>(color(.65, .05, .05));
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
-    auto green = make_shared<lambertian>(color(.12, .45, .15));
-    auto light = make_shared<diffuse_light>(color(15, 15, 15));
-
-    objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
-    objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
-    objects.add(make_shared<xz_rect>(213, 343, 227, 332, 554, light));
-    objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
-    objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
-    objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
-
-    shared_ptr<hittable> box1 = make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+    auto red = make_scene_object<lambertian>(color(.65, .05, .05));
+    auto white = make_scene_object<lambertian>(color(.73, .73, .73));
+    auto green = make_scene_object<lambertian>(color(.12, .45, .15));
+    auto light = make_scene_object<diffuse_light>(color(15, 15, 15));
+
+    objects.add(make_scene_object<yz_rect>(0, 555, 0, 555, 555, green));
+    objects.add(make_scene_object<yz_rect>(0, 555, 0, 555, 0, red));
+    objects.add(make_scene_object<xz_rect>(213, 343, 227, 332, 554, light));
+    objects.add(make_scene_object<xz_rect>(0, 555, 0, 555, 0, white));
+    objects.add(make_scene_object<xz_rect>(0, 555, 0, 555, 555, white));
+    objects.add(make_scene_object<xy_rect>(0, 555, 0, 555, 555, white));
+
+    shared_ptr<hittable> box1 = make_scene_object<box>(point3(0, 0, 0), point3(165, 330, 165), white);
+    box1 = make_scene_object<rotate_y>(box1, 15);
+    box1 = flatten_transforms(make_scene_object<translate>(box1, vec3(265, 0, 295)));
     objects.add(box1);
 
-    shared_ptr<hittable> box2 = make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white);
-    box2 = make_shared<rotate_y>(box2, -18);
-    box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+    shared_ptr<hittable> box2 = make_scene_object<box>(point3(0, 0, 0), point3(165, 165, 165), white);
+    box2 = make_scene_object<rotate_y>(box2, -18);
+    box2 = flatten_transforms(make_scene_object<translate>(box2, vec3(130, 0, 65)));
     objects.add(box2);
 
     bvh_node world(objects, 0, 1);
@@ -156,28 +158,28 @@ bvh_node cornell_smoke()
 {
     hittable_list objects;
 
-    auto red = make_shared<lambertian>(color(.65, .05, .05));
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
-    auto green = make_shared<lambertian>(color(.12, .45, .15));
-    auto light = make_shared<diffuse_light>(color(7, 7, 7));
+    auto red = make_scene_object<lambertian>(color(.65, .05, .05));
+    auto white = make_scene_object<lambertian>(color(.73, .73, .73));
+    auto green = make_scene_object<lambertian>(color(.12, .45, .15));
+    auto light = make_scene_object<diffuse_light>(color(7, 7, 7));
 
-    objects.add(make_shared<yz_rect>(0, 555, 0, 555, 555, green));
-    objects.add(make_shared<yz_rect>(0, 555, 0, 555, 0, red));
-    objects.add(make_shared<xz_rect>(113, 443, 127, 432, 554, light));
-    objects.add(make_shared<xz_rect>(0, 555, 0, 555, 555, white));
-    objects.add(make_shared<xz_rect>(0, 555, 0, 555, 0, white));
-    objects.add(make_shared<xy_rect>(0, 555, 0, 555, 555, white));
+    objects.add(make_scene_object<yz_rect>(0, 555, 0, 555, 555, green));
+    objects.add(make_scene_object<yz_rect>(0, 555, 0, 555, 0, red));
+    objects.add(make_scene_object<xz_rect>(113, 443, 127, 432, 554, light));
+    objects.add(make_scene_object<xz_rect>(0, 555, 0, 555, 555, white));
+    objects.add(make_scene_object<xz_rect>(0, 555, 0, 555, 0, white));
+    objects.add(make_scene_object<xy_rect>(0, 555, 0, 555, 555, white));
 
-    shared_ptr<hittable> box1 = make_shared<box>(point3(0, 0, 0), point3(165, 330, 165), white);
-    box1 = make_shared<rotate_y>(box1, 15);
-    box1 = make_shared<translate>(box1, vec3(265, 0, 295));
+    shared_ptr<hittable> box1 = make_scene_object<box>(point3(0, 0, 0), point3(165, 330, 165), white);
+    box1 = make_scene_object<rotate_y>(box1, 15);
+    box1 = flatten_transforms(make_scene_object<translate>(box1, vec3(265, 0, 295)));
 
-    shared_ptr<hittable> box2 = make_shared<box>(point3(0, 0, 0), point3(165, 165, 165), white);
-    box2 = make_shared<rotate_y>(box2, -18);
-    box2 = make_shared<translate>(box2, vec3(130, 0, 65));
+    shared_ptr<hittable> box2 = make_scene_object<box>(point3(0, 0, 0), point3(165, 165, 165), white);
+    box2 = make_scene_object<rotate_y>(box2, -18);
+    box2 = flatten_transforms(make_scene_object<translate>(box2, vec3(130, 0, 65)));
 
-    objects.add(make_shared<constant_medium>(box1, 0.01, color(0, 0, 0)));
-    objects.add(make_shared<constant_medium>(box2, 0.01, color(1, 1, 1)));
+    objects.add(make_scene_object<constant_medium>(box1, 0.01, color(0, 0, 0)));
+    objects.add(make_scene_object<constant_medium>(box2, 0.01, color(1, 1, 1)));
 
     bvh_node world(objects, 0, 1);
     return world;
@@ -185,7 +187,7 @@ bvh_node cornell_smoke()
 
 bvh_node final_scene() {
     hittable_list boxes1;
-    auto ground = make_shared<lambertian>(color(0.48, 0.83, 0.53));
+    auto ground = make_scene_object<lambertian>(color(0.48, 0.83, 0.53));
 
     const int boxes_per_side = 20;
     for (int i = 0; i < boxes_per_side; i++) {
@@ -198,51 +200,52 @@ bvh_node final_scene() {
             auto y1 = random_double(1,101);
             auto z1 = z0 + w;
 
-            boxes1.add(make_shared<box>(point3(x0,y0,z0), point3(x1,y1,z1), ground));
+            boxes1.add(make_scene_object<box>(point3(x0,y0,z0), point3(x1,y1,z1), ground));
         }
     }
 
     hittable_list objects;
 
-    objects.add(make_shared<bvh_node>(boxes1, 0, 1));
+    objects.add(make_scene_object<bvh_node>(boxes1, 0, 1));
 
-    auto light = make_shared<diffuse_light>(color(7, 7, 7));
-    objects.add(make_shared<xz_rect>(123, 423, 147, 412, 554, light));
+    auto light = make_scene_object<diffuse_light>(color(7, 7, 7));
+    objects.add(make_scene_object<xz_rect>(123, 423, 147, 412, 554, light));
 
     auto center1 = point3(400, 400, 200);
     auto center2 = center1 + vec3(30,0,0);
-    auto moving_sphere_material = make_shared<lambertian>(color(0.7, 0.3, 0.1));
-    objects.add(make_shared<moving_sphere>(center1, center2, 0, 1, 50, moving_sphere_material));
+    auto moving_sphere_material = make_scene_object<lambertian>(color(0.7, 0.3, 0.1));
+    objects.add(make_scene_object<moving_sphere>(center1, center2, 0, 1, 50, moving_sphere_material));
 
-    objects.add(make_shared<sphere>(point3(260, 150, 45), 50, make_shared<dielectric>(1.5)));
-    objects.add(make_shared<sphere>(
-        point3(0, 150, 145), 50, make_shared<metal>(color(0.8, 0.8, 0.9), 1.0)
+    objects.add(make_scene_object<sphere>(point3(260, 150, 45), 50, make_scene_object<dielectric>(1.5)));
+    objects.add(make_scene_object<sphere>(
+        point3(0, 150, 145), 50, make_scene_object<metal>(color(0.8, 0.8, 0.9), 1.0)
     ));
 
-    auto boundary = make_shared<sphere>(point3(360,150,145), 70, make_shared<dielectric>(1.5));
+    auto boundary = make_scene_object<sphere>(point3(360,150,145), 70, make_scene_object<dielectric>(1.5));
     objects.add(boundary);
-    objects.add(make_shared<constant_medium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
-    boundary = make_shared<sphere>(point3(0, 0, 0), 5000, make_shared<dielectric>(1.5));
-    objects.add(make_shared<constant_medium>(boundary, .0001, color(1,1,1)));
+    objects.add(make_scene_object<constant_medium>(boundary, 0.2, color(0.2, 0.4, 0.9)));
+    boundary = make_scene_object<sphere>(point3(0, 0, 0), 5000, make_scene_object<dielectric>(1.5));
+    objects.add(make_scene_object<constant_medium>(boundary, .0001, color(1,1,1)));
 
-    auto emat = make_shared<lambertian>(make_shared<image_texture>("../assets/earthmap.jpeg"));
-    objects.add(make_shared<sphere>(point3(400,200,400), 100, emat));
-    auto pertext = make_shared<noise_texture>(0.1);
-    objects.add(make_shared<sphere>(point3(220,280,300), 80, make_shared<lambertian>(pertext)));
+    auto emat = make_scene_object<lambertian>(make_scene_object<image_texture>("../assets/earthmap.jpeg"));
+    objects.add(make_scene_object<sphere>(point3(400,200,400), 100, emat));
+    auto pertext = make_scene_object<noise_texture>(0.1);
+    objects.add(make_scene_object<sphere>(point3(220,280,300), 80, make_scene_object<lambertian>(pertext)));
 
-    hittable_list boxes2;
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
+    auto boxes2 = make_scene_object<sphere_set>();
+    auto white = make_scene_object<lambertian>(color(.73, .73, .73));
     int ns = 1000;
+    boxes2->reserve(ns);
     for (int j = 0; j < ns; j++) {
-        boxes2.add(make_shared<sphere>(point3::random(0,165), 10, white));
+        boxes2->add(point3::random(0,165), 10, white);
     }
+    boxes2->build();
 
-    objects.add(make_shared<translate>(
-        make_shared<rotate_y>(
-            make_shared<bvh_node>(boxes2, 0.0, 1.0), 15),
-            vec3(-100,270,395)
+    objects.add(flatten_transforms(make_scene_object<translate>(
+        make_scene_object<rotate_y>(boxes2, 15),
+        vec3(-100,270,395)
         )
-    );
+    ));
 
     bvh_node world(objects, 0, 1);
     return world;
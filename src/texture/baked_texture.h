@@ -0,0 +1,288 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "headers.h"
+#include "aabb.h"
+#include "texture/texture.h"
+#include "texture/texture_program.h"
+
+// Procedural texture sampled into 3D grids, one over the bounds of each object that uses it, and
+// then looked up with trilinear filtering. Grids are sized by the texture's feature_size(), so
+// they keep its detail. A lookup finds its grid through the object id of the shading point.
+// Objects without a grid, such as objects too large to bake or ones that are not compiled
+// primitives, and lookups without an object id fall back to the source.
+class baked_texture : public texture
+{
+public:
+    struct grid
+    {
+        aabb bounds;
+        int nx = 0, ny = 0, nz = 0;
+        std::vector<float> texels; // RGB, x fastest
+
+        point3 sample_point(int i, int j, int k) const
+        {
+            auto min = bounds.min();
+            auto extent = bounds.max() - bounds.min();
+            return point3(min.x() + extent.x() * i / (nx - 1),
+                          min.y() + extent.y() * j / (ny - 1),
+                          min.z() + extent.z() * k / (nz - 1));
+        }
+
+        const float *texel(int i, int j, int k) const
+        {
+            return &texels[((static_cast<size_t>(k) * ny + j) * nx + i) * 3];
+        }
+    };
+
+    shared_ptr<texture> source;
+    std::vector<grid> grids;
+    std::vector<int> object_grids; // index into grids per object id, -1 for objects without one
+
+public:
+    baked_texture() {}
+    baked_texture(shared_ptr<texture> source) : source(source) {}
+
+    // Adds an unbaked grid for object `object_id` over its bounds `box`, with samples half the
+    // source's feature size apart. Returns false and adds nothing if that would take more than
+    // `max_samples` along an axis.
+    bool add_grid(const aabb &box, int object_id, int max_samples);
+
+    // Samples the source into grid `g` on `threads` threads.
+    void bake(grid &g, int threads) const;
+
+    // Content key of a grid's bake: its size, bounds and source values at fixed points in the
+    // bounds, so a changed texture or scene never matches an old cache entry.
+    uint64_t cache_key(const grid &g) const;
+
+    bool load(grid &g, const std::string &path) const;
+    bool save(const grid &g, const std::string &path) const;
+
+    virtual color value(double u, double v, const point3 &p) const override { return source->value(u, v, p); }
+
+    virtual int compile(texture_program &program) const override
+    {
+        texture_instruction instruction;
+        instruction.kernel = kernel;
+        instruction.source = this;
+        return program.emit(instruction);
+    }
+
+    virtual void collect_textures(std::vector<const texture *> &out) const override
+    {
+        out.push_back(source.get());
+    }
+
+    virtual size_t heap_bytes() const override
+    {
+        size_t bytes = grids.capacity() * sizeof(grid) + object_grids.capacity() * sizeof(int);
+        for (const auto &g : grids)
+        {
+            bytes += g.texels.capacity() * sizeof(float);
+        }
+        return bytes;
+    }
+
+private:
+    color lookup(const shading_point &pt) const;
+
+    static void kernel(const texture_instruction &instruction, const texture_batch &batch)
+    {
+        auto self = static_cast<const baked_texture *>(instruction.source);
+        auto dst = batch.reg(instruction.dst);
+        for (int i = 0; i < batch.count; i++)
+        {
+            dst[i] = self->lookup(batch.points[i]);
+        }
+    }
+};
+
+bool baked_texture::add_grid(const aabb &box, int object_id, int max_samples)
+{
+    auto spacing = source->feature_size() / 2;
+    if (!(spacing > 0))
+    {
+        return false;
+    }
+
+    // Flat bounds (rectangles) get a thin slab so every axis has a valid extent.
+    auto extent = box.max() - box.min();
+    auto longest = fmax(extent.x(), fmax(extent.y(), extent.z()));
+    auto pad = fmax(1e-4 * longest, 1e-4);
+    grid g;
+    g.bounds = aabb(box.min() - vec3(pad, pad, pad), box.max() + vec3(pad, pad, pad));
+    extent = g.bounds.max() - g.bounds.min();
+    int samples[3];
+    for (int a = 0; a < 3; a++)
+    {
+        auto needed = std::ceil(extent[a] / spacing) + 1;
+        if (needed > max_samples)
+        {
+            return false;
+        }
+        samples[a] = std::max(2, static_cast<int>(needed));
+    }
+    g.nx = samples[0];
+    g.ny = samples[1];
+    g.nz = samples[2];
+    if (object_id >= static_cast<int>(object_grids.size()))
+    {
+        object_grids.resize(object_id + 1, -1);
+    }
+    object_grids[object_id] = static_cast<int>(grids.size());
+    grids.push_back(std::move(g));
+    return true;
+}
+
+void baked_texture::bake(grid &g, int threads) const
+{
+    g.texels.assign(static_cast<size_t>(g.nx) * g.ny * g.nz * 3, 0.0f);
+
+    // Slices are interleaved across threads; procedural textures are read-only. Each row is
+    // evaluated as one batch of the source's compiled program.
+    texture_program program(*source);
+    auto bake_slices = [&g, threads, &program](int first)
+    {
+        std::vector<shading_point> points(g.nx);
+        std::vector<color> values(g.nx);
+        for (int k = first; k < g.nz; k += threads)
+        {
+            for (int j = 0; j < g.ny; j++)
+            {
+                for (int i = 0; i < g.nx; i++)
+                {
+                    points[i].p = g.sample_point(i, j, k);
+                }
+                program.evaluate(points.data(), g.nx, values.data());
+                auto dst = &g.texels[(static_cast<size_t>(k) * g.ny + j) * g.nx * 3];
+                for (int i = 0; i < g.nx; i++)
+                {
+                    dst[i * 3 + 0] = static_cast<float>(values[i].x());
+                    dst[i * 3 + 1] = static_cast<float>(values[i].y());
+                    dst[i * 3 + 2] = static_cast<float>(values[i].z());
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++)
+    {
+        workers.emplace_back(bake_slices, t);
+    }
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+}
+
+uint64_t baked_texture::cache_key(const grid &g) const
+{
+    // FNV-1a
+    uint64_t hash = 1469598103934665603ull;
+    auto mix = [&hash](const void *data, size_t size)
+    {
+        auto bytes = static_cast<const unsigned char *>(data);
+        for (size_t i = 0; i < size; i++)
+        {
+            hash = (hash ^ bytes[i]) * 1099511628211ull;
+        }
+    };
+
+    int dims[3] = {g.nx, g.ny, g.nz};
+    mix(dims, sizeof(dims));
+    const auto &bounds = g.bounds;
+    double box[6] = {bounds.min().x(), bounds.min().y(), bounds.min().z(), bounds.max().x(), bounds.max().y(), bounds.max().z()};
+    mix(box, sizeof(box));
+
+    // Probe points from a fixed sequence, so baking never disturbs the scene's random stream.
+    uint32_t state = 12345;
+    auto next = [&state]()
+    {
+        state = state * 1664525u + 1013904223u;
+        return (state >> 8) * (1.0 / 16777216.0);
+    };
+    auto min = bounds.min();
+    auto extent = bounds.max() - bounds.min();
+    for (int s = 0; s < 64; s++)
+    {
+        auto x = next(), y = next(), z = next();
+        auto c = source->value(0, 0, point3(min.x() + extent.x() * x, min.y() + extent.y() * y, min.z() + extent.z() * z));
+        float rgb[3] = {static_cast<float>(c.x()), static_cast<float>(c.y()), static_cast<float>(c.z())};
+        mix(rgb, sizeof(rgb));
+    }
+    return hash;
+}
+
+bool baked_texture::load(grid &g, const std::string &path) const
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[4];
+    int dims[3];
+    if (!in.read(magic, 4) || std::memcmp(magic, "RTB1", 4) != 0 ||
+        !in.read(reinterpret_cast<char *>(dims), sizeof(dims)) || dims[0] != g.nx || dims[1] != g.ny || dims[2] != g.nz)
+    {
+        return false;
+    }
+    std::vector<float> data(static_cast<size_t>(g.nx) * g.ny * g.nz * 3);
+    if (!in.read(reinterpret_cast<char *>(data.data()), data.size() * sizeof(float)))
+    {
+        return false;
+    }
+    g.texels = std::move(data);
+    return true;
+}
+
+bool baked_texture::save(const grid &g, const std::string &path) const
+{
+    std::ofstream out(path, std::ios::binary);
+    int dims[3] = {g.nx, g.ny, g.nz};
+    out.write("RTB1", 4);
+    out.write(reinterpret_cast<const char *>(dims), sizeof(dims));
+    out.write(reinterpret_cast<const char *>(g.texels.data()), g.texels.size() * sizeof(float));
+    return static_cast<bool>(out);
+}
+
+color baked_texture::lookup(const shading_point &pt) const
+{
+    auto index = pt.object_id >= 0 && pt.object_id < static_cast<int>(object_grids.size()) ? object_grids[pt.object_id] : -1;
+    if (index < 0 || grids[index].texels.empty())
+    {
+        return source->value(pt.u, pt.v, pt.p);
+    }
+
+    // The object lies within its grid; points off it by rounding clamp to the edge.
+    const auto &g = grids[index];
+    const auto &p = pt.p;
+    auto min = g.bounds.min();
+    auto extent = g.bounds.max() - g.bounds.min();
+    auto gx = (p.x() - min.x()) / extent.x() * (g.nx - 1);
+    auto gy = (p.y() - min.y()) / extent.y() * (g.ny - 1);
+    auto gz = (p.z() - min.z()) / extent.z() * (g.nz - 1);
+    auto i = std::min(static_cast<int>(fmax(gx, 0.0)), g.nx - 2);
+    auto j = std::min(static_cast<int>(fmax(gy, 0.0)), g.ny - 2);
+    auto k = std::min(static_cast<int>(fmax(gz, 0.0)), g.nz - 2);
+    auto fx = static_cast<float>(clamp(gx - i, 0.0, 1.0));
+    auto fy = static_cast<float>(clamp(gy - j, 0.0, 1.0));
+    auto fz = static_cast<float>(clamp(gz - k, 0.0, 1.0));
+
+    float rgb[3];
+    for (int c = 0; c < 3; c++)
+    {
+        auto c00 = g.texel(i, j, k)[c] + fx * (g.texel(i + 1, j, k)[c] - g.texel(i, j, k)[c]);
+        auto c10 = g.texel(i, j + 1, k)[c] + fx * (g.texel(i + 1, j + 1, k)[c] - g.texel(i, j + 1, k)[c]);
+        auto c01 = g.texel(i, j, k + 1)[c] + fx * (g.texel(i + 1, j, k + 1)[c] - g.texel(i, j, k + 1)[c]);
+        auto c11 = g.texel(i, j + 1, k + 1)[c] + fx * (g.texel(i + 1, j + 1, k + 1)[c] - g.texel(i, j + 1, k + 1)[c]);
+        auto c0 = c00 + fy * (c10 - c00);
+        auto c1 = c01 + fy * (c11 - c01);
+        rgb[c] = c0 + fz * (c1 - c0);
+    }
+    return color(rgb[0], rgb[1], rgb[2]);
+}
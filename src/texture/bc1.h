@@ -0,0 +1,311 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "texture/mipmap.h"
+
+// BC1 (DXT1) block compression: every 4x4 texel block is stored in 8 bytes as two RGB565
+// endpoints and sixteen 2-bit indices into the palette {c0, c1, 2/3 c0 + 1/3 c1,
+// 1/3 c0 + 2/3 c1}. Only the four color mode is produced.
+inline uint16_t bc1_pack565(const float rgb[3])
+{
+    auto r = static_cast<uint16_t>(std::lround(std::clamp(rgb[0], 0.0f, 1.0f) * 31));
+    auto g = static_cast<uint16_t>(std::lround(std::clamp(rgb[1], 0.0f, 1.0f) * 63));
+    auto b = static_cast<uint16_t>(std::lround(std::clamp(rgb[2], 0.0f, 1.0f) * 31));
+    return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+inline void bc1_unpack565(uint16_t c, float rgb[3])
+{
+    rgb[0] = ((c >> 11) & 31) * (1.0f / 31);
+    rgb[1] = ((c >> 5) & 63) * (1.0f / 63);
+    rgb[2] = (c & 31) * (1.0f / 31);
+}
+
+inline void bc1_palette(uint64_t block, float colors[4][3])
+{
+    bc1_unpack565(static_cast<uint16_t>(block), colors[0]);
+    bc1_unpack565(static_cast<uint16_t>(block >> 16), colors[1]);
+    for (int c = 0; c < 3; c++)
+    {
+        colors[2][c] = (2 * colors[0][c] + colors[1][c]) * (1.0f / 3);
+        colors[3][c] = (colors[0][c] + 2 * colors[1][c]) * (1.0f / 3);
+    }
+}
+
+// Decodes texel (x, y), both in [0, 4), of a block.
+inline void bc1_decode(uint64_t block, int x, int y, float rgb[3])
+{
+    auto index = static_cast<int>((block >> (32 + 2 * (y * 4 + x))) & 3);
+    float rgb0[3], rgb1[3];
+    bc1_unpack565(static_cast<uint16_t>(block), rgb0);
+    bc1_unpack565(static_cast<uint16_t>(block >> 16), rgb1);
+    const float w1[4] = {0, 1, 1.0f / 3, 2.0f / 3};
+    for (int c = 0; c < 3; c++)
+    {
+        rgb[c] = rgb0[c] + w1[index] * (rgb1[c] - rgb0[c]);
+    }
+}
+
+// Block with endpoints c0 > c1 and each texel mapped to its nearest palette entry; `error`
+// receives the summed squared error.
+inline uint64_t bc1_assign_indices(const float texels[16][3], uint16_t c0, uint16_t c1, float &error)
+{
+    uint64_t block = uint64_t(c0) | (uint64_t(c1) << 16);
+    float colors[4][3];
+    bc1_palette(block, colors);
+    auto count = c0 == c1 ? 1 : 4;
+
+    error = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0;
+        auto best_distance = INFINITY;
+        for (int k = 0; k < count; k++)
+        {
+            float d[3] = {texels[i][0] - colors[k][0], texels[i][1] - colors[k][1], texels[i][2] - colors[k][2]};
+            auto distance = d[0] * d[0] + d[1] * d[1] + d[2] * d[2];
+            if (distance < best_distance)
+            {
+                best_distance = distance;
+                best = k;
+            }
+        }
+        block |= uint64_t(best) << (32 + 2 * i);
+        error += best_distance;
+    }
+    return block;
+}
+
+// Encodes 16 texels in row order. Endpoints are the extremes of the block along its
+// principal axis, pulled in slightly so the interpolated colors land on the cluster.
+inline uint64_t bc1_encode(const float texels[16][3])
+{
+    float mean[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            mean[c] += texels[i][c] * (1.0f / 16);
+        }
+    }
+
+    float cov[6] = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 16; i++)
+    {
+        float d[3] = {texels[i][0] - mean[0], texels[i][1] - mean[1], texels[i][2] - mean[2]};
+        cov[0] += d[0] * d[0];
+        cov[1] += d[0] * d[1];
+        cov[2] += d[0] * d[2];
+        cov[3] += d[1] * d[1];
+        cov[4] += d[1] * d[2];
+        cov[5] += d[2] * d[2];
+    }
+
+    float axis[3] = {1, 1, 1};
+    for (int iteration = 0; iteration < 4; iteration++)
+    {
+        float next[3] = {cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+                         cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+                         cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2]};
+        auto length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+        if (length < 1e-12f)
+        {
+            break;
+        }
+        for (int c = 0; c < 3; c++)
+        {
+            axis[c] = next[c] / length;
+        }
+    }
+
+    float lo = 0, hi = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        auto t = (texels[i][0] - mean[0]) * axis[0] + (texels[i][1] - mean[1]) * axis[1] + (texels[i][2] - mean[2]) * axis[2];
+        lo = std::min(lo, t);
+        hi = std::max(hi, t);
+    }
+    auto inset = (hi - lo) / 16;
+    lo += inset;
+    hi -= inset;
+
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++)
+    {
+        end0[c] = mean[c] + hi * axis[c];
+        end1[c] = mean[c] + lo * axis[c];
+    }
+    auto c0 = bc1_pack565(end0);
+    auto c1 = bc1_pack565(end1);
+    if (c0 < c1)
+    {
+        std::swap(c0, c1);
+    }
+
+    float error;
+    auto block = bc1_assign_indices(texels, c0, c1, error);
+    if (c0 == c1)
+    {
+        return block;
+    }
+
+    // One least-squares refit of the endpoints to the chosen indices; kept only if it helps.
+    const float w1[4] = {0, 1, 1.0f / 3, 2.0f / 3};
+    float aa = 0, ab = 0, bb = 0, ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+    for (int i = 0; i < 16; i++)
+    {
+        auto b = w1[(block >> (32 + 2 * i)) & 3];
+        auto a = 1 - b;
+        aa += a * a;
+        ab += a * b;
+        bb += b * b;
+        for (int c = 0; c < 3; c++)
+        {
+            ax[c] += a * texels[i][c];
+            bx[c] += b * texels[i][c];
+        }
+    }
+    auto det = aa * bb - ab * ab;
+    if (fabs(det) > 1e-8f)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            end0[c] = (bb * ax[c] - ab * bx[c]) / det;
+            end1[c] = (aa * bx[c] - ab * ax[c]) / det;
+        }
+        auto r0 = bc1_pack565(end0);
+        auto r1 = bc1_pack565(end1);
+        if (r0 < r1)
+        {
+            std::swap(r0, r1);
+        }
+        float refit_error;
+        auto refit = bc1_assign_indices(texels, r0, r1, refit_error);
+        if (refit_error < error)
+        {
+            return refit;
+        }
+    }
+    return block;
+}
+
+// Mip pyramid held as BC1 blocks, 0.5 bytes per texel instead of the 12 of a float mipmap.
+// Blocks of a level are stored row by row, so a 4x4 block is the unit of locality.
+class bc1_mipmap
+{
+public:
+    struct level
+    {
+        int width = 0;
+        int height = 0;
+        int blocks_x = 0;
+        std::vector<uint64_t> blocks;
+    };
+
+    // Compression error of the full resolution level, in 8-bit steps.
+    struct error_report
+    {
+        double rmse = 0;
+        double max = 0;
+    };
+
+public:
+    bc1_mipmap() {}
+    bc1_mipmap(const mipmap &source);
+
+    bool empty() const { return pyramid.empty(); }
+    int width(int level = 0) const { return pyramid[level].width; }
+    int height(int level = 0) const { return pyramid[level].height; }
+    int levels() const { return static_cast<int>(pyramid.size()); }
+
+    color texel(int level, int x, int y) const;
+
+    color trilinear(double s, double t, double filter_width) const { return trilinear_lookup(*this, s, t, filter_width); }
+
+    // Compares level 0 against the uncompressed source it was built from.
+    error_report error(const mipmap &source) const;
+
+    size_t heap_bytes() const;
+
+private:
+    std::vector<level> pyramid;
+};
+
+bc1_mipmap::bc1_mipmap(const mipmap &source)
+{
+    for (int l = 0; l < source.levels(); l++)
+    {
+        level dst;
+        dst.width = source.width(l);
+        dst.height = source.height(l);
+        dst.blocks_x = (dst.width + 3) / 4;
+        auto blocks_y = (dst.height + 3) / 4;
+        dst.blocks.resize(static_cast<size_t>(dst.blocks_x) * blocks_y);
+
+        float texels[16][3];
+        for (int by = 0; by < blocks_y; by++)
+        {
+            for (int bx = 0; bx < dst.blocks_x; bx++)
+            {
+                for (int i = 0; i < 16; i++)
+                {
+                    auto c = source.texel(l, bx * 4 + i % 4, by * 4 + i / 4);
+                    texels[i][0] = static_cast<float>(c.x());
+                    texels[i][1] = static_cast<float>(c.y());
+                    texels[i][2] = static_cast<float>(c.z());
+                }
+                dst.blocks[static_cast<size_t>(by) * dst.blocks_x + bx] = bc1_encode(texels);
+            }
+        }
+        pyramid.push_back(std::move(dst));
+    }
+}
+
+color bc1_mipmap::texel(int level, int x, int y) const
+{
+    const auto &l = pyramid[level];
+    x = std::clamp(x, 0, l.width - 1);
+    y = std::clamp(y, 0, l.height - 1);
+    float rgb[3];
+    bc1_decode(l.blocks[static_cast<size_t>(y / 4) * l.blocks_x + x / 4], x % 4, y % 4, rgb);
+    return color(rgb[0], rgb[1], rgb[2]);
+}
+
+bc1_mipmap::error_report bc1_mipmap::error(const mipmap &source) const
+{
+    error_report report;
+    if (empty())
+    {
+        return report;
+    }
+
+    double sum = 0;
+    for (int y = 0; y < height(); y++)
+    {
+        for (int x = 0; x < width(); x++)
+        {
+            auto d = texel(0, x, y) - source.texel(0, x, y);
+            for (int c = 0; c < 3; c++)
+            {
+                auto e = fabs(d[c]) * 255;
+                sum += e * e;
+                report.max = fmax(report.max, e);
+            }
+        }
+    }
+    report.rmse = sqrt(sum / (3.0 * width() * height()));
+    return report;
+}
+
+size_t bc1_mipmap::heap_bytes() const
+{
+    size_t bytes = 0;
+    for (const auto &l : pyramid)
+    {
+        bytes += l.blocks.capacity() * sizeof(uint64_t);
+    }
+    return bytes;
+}
@@ -3,6 +3,7 @@
 #include "headers.h"
 #include "texture.h"
 #include "solid_color.h"
+#include "texture/texture_program.h"
 
 class checker_texture : public texture
 {
@@ -13,12 +14,11 @@ public:
 public:
     checker_texture() {}
     checker_texture(shared_ptr<texture> _odd, shared_ptr<texture> _even) : odd(_odd), even(_even) {}
-    checker_texture(color c1, color c2) : odd(make_shared<solid_color>(c1)),even(make_shared<solid_color>(c2)) {}
+    checker_texture(color c1, color c2) : odd(make_scene_object<solid_color>(c1)),even(make_scene_object<solid_color>(c2)) {}
 
     virtual color value(double u, double v, const point3 &p) const override
     {
-        auto sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
-        if (sines < 0)
+        if (odd_cell(p))
         {
             return odd->value(u, v, p);
         }
@@ -27,4 +27,82 @@ public:
             return even->value(u, v, p);
         }
     }
+
+    // Fades towards the average of both textures as the footprint grows to the size of a
+    // checker cell, where point samples would only alias.
+    virtual color filtered_value(double u, double v, const point3 &p, const texture_footprint &footprint) const override
+    {
+        auto sample = odd_cell(p) ? odd->filtered_value(u, v, p, footprint) : even->filtered_value(u, v, p, footprint);
+
+        auto blend = average_weight(footprint);
+        if (blend == 0)
+        {
+            return sample;
+        }
+        auto average = 0.5 * (odd->filtered_value(u, v, p, footprint) + even->filtered_value(u, v, p, footprint));
+        return (1 - blend) * sample + blend * average;
+    }
+
+    virtual int compile(texture_program &program) const override
+    {
+        texture_instruction instruction;
+        instruction.kernel = select_kernel;
+        instruction.a = program.compile(*odd);
+        instruction.b = program.compile(*even);
+        instruction.c = program.emit_input(cell_kernel);
+        return program.emit(instruction);
+    }
+
+    virtual bool procedural() const override { return true; }
+
+    // Cells are pi / 10 wide, but their edges are sharp: interpolating between texels blurs each
+    // edge over a texel, so only grids of 16 texels per cell or finer stay close to the original.
+    virtual double feature_size() const override
+    {
+        return fmin(pi / 80, fmin(odd->feature_size(), even->feature_size()));
+    }
+
+    virtual void collect_textures(std::vector<const texture *> &out) const override
+    {
+        out.push_back(odd.get());
+        out.push_back(even.get());
+    }
+
+private:
+    static bool odd_cell(const point3 &p)
+    {
+        auto sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
+        return sines < 0;
+    }
+
+    static double average_weight(const texture_footprint &footprint)
+    {
+        const auto cell = pi / 10;
+        return clamp(footprint.p / cell - 0.5, 0.0, 1.0);
+    }
+
+    // 1 in odd cells and 0 in even ones, computed once for all checkers of a program.
+    static void cell_kernel(const texture_instruction &instruction, const texture_batch &batch)
+    {
+        auto dst = batch.reg(instruction.dst);
+        for (int i = 0; i < batch.count; i++)
+        {
+            dst[i] = odd_cell(batch.points[i].p) ? color::identity() : color::zero();
+        }
+    }
+
+    // Selects between the odd (a) and even (b) registers by the cell register (c).
+    static void select_kernel(const texture_instruction &instruction, const texture_batch &batch)
+    {
+        auto dst = batch.reg(instruction.dst);
+        auto odd = batch.reg(instruction.a);
+        auto even = batch.reg(instruction.b);
+        auto cells = batch.reg(instruction.c);
+        for (int i = 0; i < batch.count; i++)
+        {
+            auto sample = cells[i].x() != 0 ? odd[i] : even[i];
+            auto blend = average_weight(batch.points[i].footprint);
+            dst[i] = blend == 0 ? sample : color((1 - blend) * sample + blend * (0.5 * (odd[i] + even[i])));
+        }
+    }
 };
\ No newline at end of file
@@ -4,61 +4,154 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "noise/perlin.h"
+#include "texture/mipmap.h"
+#include "texture/bc1.h"
+#include "texture/tile_cache.h"
+#include "texture/texture_program.h"
 
+// RGB image texture. A converted .rtt file next to the image (same name, .rtt extension) is
+// preferred: its tiles are then faulted in on demand through the global tile cache instead of
+// decoding the whole image into memory. A converted file whose recorded source size or
+// modification time differs from the image's is stale and ignored. Decoded images can be kept
+// BC1 compressed instead.
 class image_texture : public texture
 {
 private:
-    unsigned char *data;
-    int width, height;
-    int bytes_per_scanline;
+    mipmap texels;
+    bc1_mipmap compressed;
+    std::unique_ptr<texture_file> tiled;
 
 public:
     const static int bytes_per_pixel = 3;
 
+    // Compress decoded images to BC1 at load time (-texture_compression bc1). Set before the
+    // scene is built.
+    inline static bool block_compression = false;
+
 public:
-    image_texture() : data(nullptr), width(0), height(0), bytes_per_scanline(0) {}
+    image_texture() {}
     image_texture(const char *filename)
     {
-        auto components_per_pixel = bytes_per_pixel;
-        data = stbi_load(filename, &width, &height, &components_per_pixel, components_per_pixel);
-        if (!data)
+        auto path = tiled_path(filename);
+        auto file = std::make_unique<texture_file>();
+        if (file->open(path))
+        {
+            texture_source source;
+            if (!texture_source::stat(filename, source) || source == file->source())
+            {
+                tiled = std::move(file);
+                return;
+            }
+            std::cerr << "WARNING: Ignoring texture file '" << path << "', it was converted from another version of '"
+                      << filename << "'; run texconvert again.\n";
+        }
+        else if (std::filesystem::exists(path))
+        {
+            std::cerr << "WARNING: Ignoring texture file '" << path << "', it is not a version " << texture_file::VERSION
+                      << " texture file; run texconvert again.\n";
+        }
+
+        texels = load_mipmap(filename);
+        if (texels.empty())
         {
             std::cerr << "ERROR: Could not load texture image file '" << filename << "'.\n";
-            width = 0;
-            height = 0;
+            return;
+        }
+
+        if (block_compression)
+        {
+            compressed = bc1_mipmap(texels);
+            auto error = compressed.error(texels);
+            std::cerr << "Texture '" << filename << "' compressed to BC1: " << texels.heap_bytes() << " -> "
+                      << compressed.heap_bytes() << " bytes, RMSE " << error.rmse << ", max error " << error.max << " (8-bit steps)\n";
+            texels = mipmap();
         }
-        bytes_per_scanline = bytes_per_pixel * width;
     }
-    ~image_texture()
+
+    // Decodes an image file into a mip pyramid; empty if the file cannot be read.
+    static mipmap load_mipmap(const char *filename)
     {
-        delete data;
+        auto components_per_pixel = bytes_per_pixel;
+        int width, height;
+        auto data = stbi_load(filename, &width, &height, &components_per_pixel, components_per_pixel);
+        if (!data)
+        {
+            return mipmap();
+        }
+
+        const auto color_scale = 1.0f / 255.0f;
+        mipmap result(data, width, height, bytes_per_pixel, color_scale);
+        stbi_image_free(data);
+        return result;
     }
 
-    virtual color value(double u, double v, const vec3 &p) const override
+    // Converted texture file for an image: the same path with an .rtt extension.
+    static std::string tiled_path(const std::string &filename)
     {
-        if (data == nullptr)
+        auto dot = filename.find_last_of('.');
+        auto slash = filename.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
         {
-            return color(1, 0, 0);
+            return filename + ".rtt";
         }
+        return filename.substr(0, dot) + ".rtt";
+    }
+
+    virtual color value(double u, double v, const vec3 &p) const override
+    {
+        return lookup(u, v, 0);
+    }
+
+    // Trilinear lookup over the uv footprint; a zero footprint samples the full resolution
+    // image bilinearly.
+    virtual color filtered_value(double u, double v, const point3 &p, const texture_footprint &footprint) const override
+    {
+        return lookup(u, v, footprint.uv);
+    }
+
+    virtual int compile(texture_program &program) const override
+    {
+        texture_instruction instruction;
+        instruction.kernel = kernel;
+        instruction.source = this;
+        return program.emit(instruction);
+    }
+
+    // Tiles of converted files live in the tile cache and are reported with it.
+    virtual size_t heap_bytes() const override
+    {
+        return texels.heap_bytes() + compressed.heap_bytes();
+    }
 
+private:
+    color lookup(double u, double v, double filter_width) const
+    {
         u = clamp(u, 0.0, 1.0);
         v = 1.0 - clamp(v, 0.0, 1.0);
 
-        auto i = static_cast<int>(u * width);
-        auto j = static_cast<int>(v * height);
-
-        if (i >= width)
+        if (tiled)
         {
-            i = width - 1;
+            return trilinear_lookup(cached_texture_file{*tiled}, u, v, filter_width);
         }
-        if (j >= height)
+        if (!compressed.empty())
         {
-            j = height - 1;
+            return compressed.trilinear(u, v, filter_width);
         }
+        if (texels.empty())
+        {
+            return color(1, 0, 0);
+        }
+        return texels.trilinear(u, v, filter_width);
+    }
 
-        const auto color_scale = 1.0 / 255.0;
-        auto pixel = data + j * bytes_per_scanline + i * bytes_per_pixel;
-
-        return color(color_scale * pixel[0], color_scale * pixel[1], color_scale * pixel[2]);
+    static void kernel(const texture_instruction &instruction, const texture_batch &batch)
+    {
+        auto self = static_cast<const image_texture *>(instruction.source);
+        auto dst = batch.reg(instruction.dst);
+        for (int i = 0; i < batch.count; i++)
+        {
+            const auto &pt = batch.points[i];
+            dst[i] = self->lookup(pt.u, pt.v, pt.footprint.uv);
+        }
     }
-};
\ No newline at end of file
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "headers.h"
+
+// Bilinear and trilinear filtering over any mip pyramid that exposes levels(), width(level),
+// height(level) and texel(level, x, y), with image space coordinates as described below.
+template <class Pyramid>
+color bilinear_lookup(const Pyramid &pyramid, int level, double s, double t)
+{
+    auto x = s * pyramid.width(level) - 0.5;
+    auto y = t * pyramid.height(level) - 0.5;
+    auto x0 = static_cast<int>(std::floor(x));
+    auto y0 = static_cast<int>(std::floor(y));
+    auto fx = x - x0;
+    auto fy = y - y0;
+
+    return (1 - fx) * (1 - fy) * pyramid.texel(level, x0, y0) +
+           fx * (1 - fy) * pyramid.texel(level, x0 + 1, y0) +
+           (1 - fx) * fy * pyramid.texel(level, x0, y0 + 1) +
+           fx * fy * pyramid.texel(level, x0 + 1, y0 + 1);
+}
+
+// Blends the two levels closest to a footprint of `filter_width` (in [0, 1] image units).
+template <class Pyramid>
+color trilinear_lookup(const Pyramid &pyramid, double s, double t, double filter_width)
+{
+    auto texels = filter_width * std::max(pyramid.width(0), pyramid.height(0));
+    if (texels <= 1)
+    {
+        return bilinear_lookup(pyramid, 0, s, t);
+    }
+
+    auto lod = std::log2(texels);
+    auto last = pyramid.levels() - 1;
+    if (lod >= last)
+    {
+        return bilinear_lookup(pyramid, last, s, t);
+    }
+
+    auto lower = static_cast<int>(lod);
+    auto blend = lod - lower;
+    return (1 - blend) * bilinear_lookup(pyramid, lower, s, t) + blend * bilinear_lookup(pyramid, lower + 1, s, t);
+}
+
+// Mip pyramid of an RGB image. Texels are converted to float once at load time and every level
+// is stored in 8x8 tiles, so a filtered lookup touches one or two cache lines per row instead of
+// striding across whole scanlines. Coordinates are in image space: s to the right, t down, both
+// in [0, 1]; lookups outside clamp to the edge.
+class mipmap
+{
+public:
+    static const int TILE_SIZE = 8;
+    static const int CHANNELS = 3;
+
+    struct level
+    {
+        int width = 0;
+        int height = 0;
+        int tiles_x = 0;
+        std::vector<float> texels;
+
+        size_t offset(int x, int y) const
+        {
+            auto tile = static_cast<size_t>(y / TILE_SIZE) * tiles_x + x / TILE_SIZE;
+            auto in_tile = (y % TILE_SIZE) * TILE_SIZE + x % TILE_SIZE;
+            return (tile * TILE_SIZE * TILE_SIZE + in_tile) * CHANNELS;
+        }
+    };
+
+public:
+    mipmap() {}
+
+    // Builds the full pyramid from `components`-channel 8-bit rows; channels are scaled by `scale`.
+    mipmap(const unsigned char *data, int width, int height, int components, float scale);
+
+    bool empty() const { return pyramid.empty(); }
+    int width(int level = 0) const { return empty() ? 0 : pyramid[level].width; }
+    int height(int level = 0) const { return empty() ? 0 : pyramid[level].height; }
+    int levels() const { return static_cast<int>(pyramid.size()); }
+
+    color texel(int level, int x, int y) const;
+
+    color bilinear(int level, double s, double t) const { return bilinear_lookup(*this, level, s, t); }
+
+    color trilinear(double s, double t, double filter_width) const { return trilinear_lookup(*this, s, t, filter_width); }
+
+    size_t heap_bytes() const;
+
+private:
+    std::vector<level> pyramid;
+
+    // Source texels along one axis covered by a texel of the next level, with their share of it:
+    // two halves on even sides, up to three on odd ones.
+    struct box_tap
+    {
+        int first = 0;
+        int count = 0;
+        float weights[3] = {};
+    };
+
+    static level make_level(int width, int height);
+    static std::vector<box_tap> box_taps(int from, int to);
+};
+
+mipmap::level mipmap::make_level(int width, int height)
+{
+    level l;
+    l.width = width;
+    l.height = height;
+    l.tiles_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    auto tiles_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    l.texels.assign(static_cast<size_t>(l.tiles_x) * tiles_y * TILE_SIZE * TILE_SIZE * CHANNELS, 0.0f);
+    return l;
+}
+
+mipmap::mipmap(const unsigned char *data, int width, int height, int components, float scale)
+{
+    if (data == nullptr || width <= 0 || height <= 0)
+    {
+        return;
+    }
+
+    auto base = make_level(width, height);
+    for (int y = 0; y < height; y++)
+    {
+        auto row = data + static_cast<size_t>(y) * width * components;
+        for (int x = 0; x < width; x++)
+        {
+            auto dst = &base.texels[base.offset(x, y)];
+            for (int c = 0; c < CHANNELS; c++)
+            {
+                dst[c] = scale * row[x * components + std::min(c, components - 1)];
+            }
+        }
+    }
+    pyramid.push_back(std::move(base));
+
+    // Each level halves the previous one, rounded down, and box filters it: a texel averages the
+    // source area it covers in uv, so levels stay aligned and every source texel contributes.
+    while (pyramid.back().width > 1 || pyramid.back().height > 1)
+    {
+        const auto &src = pyramid.back();
+        auto next = make_level(std::max(1, src.width / 2), std::max(1, src.height / 2));
+        auto columns = box_taps(src.width, next.width);
+        auto rows = box_taps(src.height, next.height);
+        for (int y = 0; y < next.height; y++)
+        {
+            const auto &row = rows[y];
+            for (int x = 0; x < next.width; x++)
+            {
+                const auto &column = columns[x];
+                auto dst = &next.texels[next.offset(x, y)];
+                for (int j = 0; j < row.count; j++)
+                {
+                    for (int i = 0; i < column.count; i++)
+                    {
+                        auto weight = row.weights[j] * column.weights[i];
+                        auto p = &src.texels[src.offset(column.first + i, row.first + j)];
+                        for (int k = 0; k < CHANNELS; k++)
+                        {
+                            dst[k] += weight * p[k];
+                        }
+                    }
+                }
+            }
+        }
+        pyramid.push_back(std::move(next));
+    }
+}
+
+std::vector<mipmap::box_tap> mipmap::box_taps(int from, int to)
+{
+    std::vector<box_tap> taps(to);
+    auto span = static_cast<double>(from) / to;
+    for (int x = 0; x < to; x++)
+    {
+        auto lo = static_cast<double>(x) * from / to;
+        auto hi = static_cast<double>(x + 1) * from / to;
+        auto &tap = taps[x];
+        tap.first = static_cast<int>(lo);
+        for (int i = tap.first; i < from && i < hi && tap.count < 3; i++)
+        {
+            auto overlap = std::min(hi, i + 1.0) - std::max(lo, static_cast<double>(i));
+            tap.weights[tap.count++] = static_cast<float>(overlap / span);
+        }
+    }
+    return taps;
+}
+
+color mipmap::texel(int level, int x, int y) const
+{
+    const auto &l = pyramid[level];
+    x = std::clamp(x, 0, l.width - 1);
+    y = std::clamp(y, 0, l.height - 1);
+    auto p = &l.texels[l.offset(x, y)];
+    return color(p[0], p[1], p[2]);
+}
+
+size_t mipmap::heap_bytes() const
+{
+    size_t bytes = 0;
+    for (const auto &l : pyramid)
+    {
+        bytes += l.texels.capacity() * sizeof(float);
+    }
+    return bytes;
+}
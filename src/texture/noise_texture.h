@@ -3,6 +3,7 @@
 #include "headers.h"
 #include "noise/perlin.h"
 #include "vec3.h"
+#include "texture/texture_program.h"
 
 class noise_texture : public texture
 {
@@ -16,6 +17,57 @@ public:
 
     virtual color value(double u, double v, const point3 &p) const override
     {
-        return color::identity() * 0.5 * (1 + sin(scale*p.z() + 10*noise.turb(p)));
+        return marble(p, 7);
+    }
+
+    // Drops the turbulence octaves whose features are smaller than the footprint.
+    virtual color filtered_value(double u, double v, const point3 &p, const texture_footprint &footprint) const override
+    {
+        return marble(p, octaves(footprint));
+    }
+
+    virtual int compile(texture_program &program) const override
+    {
+        texture_instruction instruction;
+        instruction.kernel = kernel;
+        instruction.source = this;
+        return program.emit(instruction);
+    }
+
+    virtual bool procedural() const override { return true; }
+
+    // Octave k of the turbulence has features 2^-k wide and shifts the marble's phase by up to
+    // 10 / 2^k; octaves past the fifth move it by well under a radian.
+    virtual double feature_size() const override { return fmin(1.0 / 16, pi / scale); }
+
+    virtual size_t heap_bytes() const override
+    {
+        return noise.heap_bytes();
+    }
+
+private:
+    color marble(const point3 &p, int depth) const
+    {
+        return color::identity() * 0.5 * (1 + sin(scale*p.z() + 10*noise.turb(p, depth)));
+    }
+
+    static int octaves(const texture_footprint &footprint)
+    {
+        if (footprint.p > 0)
+        {
+            return static_cast<int>(clamp(std::floor(-std::log2(footprint.p)) + 1, 1.0, 7.0));
+        }
+        return 7;
+    }
+
+    static void kernel(const texture_instruction &instruction, const texture_batch &batch)
+    {
+        auto self = static_cast<const noise_texture *>(instruction.source);
+        auto dst = batch.reg(instruction.dst);
+        for (int i = 0; i < batch.count; i++)
+        {
+            const auto &pt = batch.points[i];
+            dst[i] = self->marble(pt.p, octaves(pt.footprint));
+        }
     }
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "headers.h"
 #include "texture.h"
+#include "texture/texture_program.h"
 
 class solid_color : public texture
 {
@@ -16,4 +17,11 @@ public:
     virtual color value(double u, double v, const point3& p) const override {
         return color_value;
     }
+
+    virtual int compile(texture_program &program) const override
+    {
+        return program.emit_constant(color_value);
+    }
+
+    virtual double feature_size() const override { return infinity; }
 };
\ No newline at end of file
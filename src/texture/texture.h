@@ -1,9 +1,44 @@
 #pragma once
 
+#include <vector>
 #include "headers.h"
 
+class texture_program;
+
+// Filter footprint of a texture lookup: how far (u, v) and p move towards the neighbouring
+// pixels. Zero widths mean a point sample.
+struct texture_footprint
+{
+    double uv = 0;
+    double p = 0;
+};
+
 class texture
 {
 public:
     virtual color value(double u, double v, const point3 &p) const = 0;
+
+    // Lookup prefiltered over `footprint`. Textures that cannot filter point sample.
+    virtual color filtered_value(double u, double v, const point3 &p, const texture_footprint &footprint) const
+    {
+        return value(u, v, p);
+    }
+
+    // True for textures computed from the shading point alone (no image data), which can be
+    // baked into lookup grids.
+    virtual bool procedural() const { return false; }
+
+    // Smallest world space distance over which the texture changes visibly, for sizing bake
+    // grids: infinity for constants, 0 where unknown, which keeps the texture from being baked.
+    virtual double feature_size() const { return 0; }
+
+    // Emits the instructions computing this texture into `program` and returns the register
+    // holding the result. The default calls filtered_value() through the vtable.
+    virtual int compile(texture_program &program) const;
+
+    // Textures this one samples from, for scene walks such as memory reports.
+    virtual void collect_textures(std::vector<const texture *> &out) const {}
+
+    // Texel data, lookup tables and other heap memory owned by the texture.
+    virtual size_t heap_bytes() const { return 0; }
 };
\ No newline at end of file
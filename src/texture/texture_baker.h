@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "compiled_scene.h"
+#include "texture/baked_texture.h"
+
+// Replaces the procedural textures referenced by the scene's materials with textures baked into
+// a grid per primitive using them, over that primitive's bounds. A primitive whose grid would
+// need more than `max_samples` along an axis to resolve the texture's features keeps the
+// procedural texture. Grids are stored in `cache_dir` under their content key and reused by
+// later renders of the same scene.
+void bake_procedural_textures(compiled_scene &scene, int max_samples, const std::string &cache_dir, int threads)
+{
+    std::vector<std::vector<compiled_scene::primitive_box>> bounds;
+    scene.primitive_bounds(bounds);
+
+    // A texture shared by several materials gets one baked texture with the grids of all of them.
+    std::vector<shared_ptr<baked_texture>> order;
+    std::unordered_map<const texture *, shared_ptr<baked_texture>> replacements;
+    int skipped = 0;
+    for (size_t m = 0; m < scene.materials.size(); m++)
+    {
+        std::vector<shared_ptr<texture> *> slots;
+        scene.materials[m]->texture_slots(slots);
+        std::vector<const texture *> seen;
+        for (auto slot : slots)
+        {
+            if (!(*slot)->procedural() || std::find(seen.begin(), seen.end(), slot->get()) != seen.end())
+            {
+                continue;
+            }
+            seen.push_back(slot->get());
+            auto &baked = replacements[slot->get()];
+            if (!baked)
+            {
+                baked = make_scene_object<baked_texture>(*slot);
+                order.push_back(baked);
+            }
+            for (const auto &primitive : bounds[m])
+            {
+                if (!baked->add_grid(primitive.box, primitive.object_id, max_samples))
+                {
+                    skipped++;
+                }
+            }
+        }
+    }
+    if (skipped > 0)
+    {
+        std::cerr << "Kept " << skipped << " procedural texture uses too large to bake at " << max_samples << " samples per axis\n";
+    }
+
+    if (!cache_dir.empty())
+    {
+        std::error_code error;
+        std::filesystem::create_directories(cache_dir, error);
+    }
+
+    for (const auto &baked : order)
+    {
+        for (auto &g : baked->grids)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            char name[32];
+            std::snprintf(name, sizeof(name), "%016llx.rtb", static_cast<unsigned long long>(baked->cache_key(g)));
+            auto path = cache_dir.empty() ? std::string() : (std::filesystem::path(cache_dir) / name).string();
+
+            bool cached = !path.empty() && baked->load(g, path);
+            if (!cached)
+            {
+                baked->bake(g, threads);
+                if (!path.empty() && !baked->save(g, path))
+                {
+                    std::cerr << "WARNING: Could not write texture bake cache '" << path << "'.\n";
+                }
+            }
+
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+            std::cerr << "Baked texture " << g.nx << "x" << g.ny << "x" << g.nz
+                      << (cached ? " from cache" : "") << " in " << elapsed.count() << "s\n";
+        }
+    }
+
+    // Textures without any grid stay as they are.
+    for (auto &m : scene.materials)
+    {
+        std::vector<shared_ptr<texture> *> slots;
+        m->texture_slots(slots);
+        for (auto slot : slots)
+        {
+            auto found = replacements.find(slot->get());
+            if (found != replacements.end() && !found->second->grids.empty())
+            {
+                *slot = found->second;
+            }
+        }
+    }
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "texture/mipmap.h"
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Tiled, mipmapped texture file (.rtt) produced offline by tools/texconvert. The file holds a
+// header, one entry per mip level and then the tiles of every level in row-major tile order.
+// A tile is TILE_SIZE x TILE_SIZE float RGB texels, padded at the right and bottom edges, and
+// tile data starts page aligned, so a mapped file can be read tile by tile without decoding.
+// The header records the size and modification time of the source image, so a file left behind
+// by an edit of the image can be told apart from a current one.
+
+struct texture_file_header
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+    uint32_t tile_size;
+    uint64_t source_size;
+    int64_t source_mtime;
+};
+
+// Size and modification time of an image file.
+struct texture_source
+{
+    uint64_t size = 0;
+    int64_t mtime = 0;
+
+    // Stamp of the file at `path`; false if it cannot be read.
+    static bool stat(const std::string &path, texture_source &out)
+    {
+        std::error_code error;
+        auto size = std::filesystem::file_size(path, error);
+        if (error)
+        {
+            return false;
+        }
+        auto time = std::filesystem::last_write_time(path, error);
+        if (error)
+        {
+            return false;
+        }
+        out.size = size;
+        out.mtime = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+        return true;
+    }
+
+    bool operator==(const texture_source &other) const { return size == other.size && mtime == other.mtime; }
+    bool operator!=(const texture_source &other) const { return !(*this == other); }
+};
+
+struct texture_file_level
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t tiles_x;
+    uint32_t tiles_y;
+    uint64_t offset;
+};
+
+class texture_file
+{
+public:
+    static const uint32_t VERSION = 2;
+    static const int TILE_SIZE = 32;
+    static const int CHANNELS = 3;
+    static const size_t TILE_FLOATS = TILE_SIZE * TILE_SIZE * CHANNELS;
+    static const size_t TILE_BYTES = TILE_FLOATS * sizeof(float);
+    static_assert(TILE_BYTES % 4096 == 0, "tiles must stay page aligned");
+
+    // Writes every level of `image`, converted from the image file stamped `source`, to `path`.
+    static bool write(const std::string &path, const mipmap &image, const texture_source &source);
+
+public:
+    texture_file() {}
+    texture_file(const texture_file &) = delete;
+    texture_file &operator=(const texture_file &) = delete;
+    ~texture_file() { close(); }
+
+    bool open(const std::string &path);
+    void close();
+    bool is_open() const { return !level_table.empty(); }
+
+    // Image the opened file was converted from.
+    const texture_source &source() const { return source_image; }
+
+    // Process-unique id of the opened file, used to key its tiles in the tile cache.
+    uint32_t id() const { return file_id; }
+
+    int levels() const { return static_cast<int>(level_table.size()); }
+    int width(int level = 0) const { return level_table[level].width; }
+    int height(int level = 0) const { return level_table[level].height; }
+    int tiles_x(int level) const { return level_table[level].tiles_x; }
+
+    // Copies the TILE_FLOATS texels of tile (tx, ty) of `level` to `out`.
+    void read_tile(int level, int tx, int ty, float *out) const;
+
+private:
+    std::vector<texture_file_level> level_table;
+    texture_source source_image;
+    uint32_t file_id = 0;
+#if defined(_WIN32)
+    mutable std::ifstream file;
+    mutable std::mutex file_mutex;
+#else
+    const unsigned char *mapping = nullptr;
+    size_t mapping_size = 0;
+#endif
+
+    static uint64_t data_offset(int levels);
+};
+
+uint64_t texture_file::data_offset(int levels)
+{
+    const uint64_t page = 4096;
+    auto table_end = sizeof(texture_file_header) + levels * sizeof(texture_file_level);
+    return (table_end + page - 1) / page * page;
+}
+
+bool texture_file::write(const std::string &path, const mipmap &image, const texture_source &source)
+{
+    std::ofstream out(path, std::ios::binary);
+    if (!out || image.empty())
+    {
+        std::cerr << "ERROR: Could not write texture file '" << path << "'.\n";
+        return false;
+    }
+
+    texture_file_header header = {{'R', 'T', 'T', '1'}, VERSION, uint32_t(image.width()), uint32_t(image.height()), uint32_t(image.levels()), TILE_SIZE,
+                                  source.size, source.mtime};
+    std::vector<texture_file_level> levels;
+    auto offset = data_offset(image.levels());
+    for (int l = 0; l < image.levels(); l++)
+    {
+        texture_file_level entry;
+        entry.width = image.width(l);
+        entry.height = image.height(l);
+        entry.tiles_x = (entry.width + TILE_SIZE - 1) / TILE_SIZE;
+        entry.tiles_y = (entry.height + TILE_SIZE - 1) / TILE_SIZE;
+        entry.offset = offset;
+        offset += uint64_t(entry.tiles_x) * entry.tiles_y * TILE_BYTES;
+        levels.push_back(entry);
+    }
+
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(levels.data()), levels.size() * sizeof(texture_file_level));
+    out.seekp(levels[0].offset);
+
+    std::vector<float> tile(TILE_FLOATS);
+    for (int l = 0; l < image.levels(); l++)
+    {
+        for (uint32_t ty = 0; ty < levels[l].tiles_y; ty++)
+        {
+            for (uint32_t tx = 0; tx < levels[l].tiles_x; tx++)
+            {
+                for (int y = 0; y < TILE_SIZE; y++)
+                {
+                    for (int x = 0; x < TILE_SIZE; x++)
+                    {
+                        auto c = image.texel(l, tx * TILE_SIZE + x, ty * TILE_SIZE + y);
+                        auto dst = &tile[(y * TILE_SIZE + x) * CHANNELS];
+                        dst[0] = static_cast<float>(c.x());
+                        dst[1] = static_cast<float>(c.y());
+                        dst[2] = static_cast<float>(c.z());
+                    }
+                }
+                out.write(reinterpret_cast<const char *>(tile.data()), TILE_BYTES);
+            }
+        }
+    }
+    return static_cast<bool>(out);
+}
+
+bool texture_file::open(const std::string &path)
+{
+    close();
+
+    std::ifstream in(path, std::ios::binary);
+    texture_file_header header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, "RTT1", 4) != 0 || header.version != VERSION || header.tile_size != TILE_SIZE || header.levels == 0)
+    {
+        return false;
+    }
+    std::vector<texture_file_level> levels(header.levels);
+    if (!in.read(reinterpret_cast<char *>(levels.data()), levels.size() * sizeof(texture_file_level)))
+    {
+        return false;
+    }
+
+#if defined(_WIN32)
+    file.open(path, std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+#else
+    auto fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        ::close(fd);
+        return false;
+    }
+    const auto &last = levels.back();
+    if (static_cast<uint64_t>(info.st_size) < last.offset + uint64_t(last.tiles_x) * last.tiles_y * TILE_BYTES)
+    {
+        ::close(fd);
+        return false;
+    }
+    auto mapped = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        return false;
+    }
+    // Tiles are faulted in by the tile cache in no particular order.
+    madvise(mapped, info.st_size, MADV_RANDOM);
+    mapping = static_cast<const unsigned char *>(mapped);
+    mapping_size = info.st_size;
+#endif
+
+    static std::atomic<uint32_t> next_id{0};
+    file_id = next_id++;
+    level_table = std::move(levels);
+    source_image.size = header.source_size;
+    source_image.mtime = header.source_mtime;
+    return true;
+}
+
+void texture_file::close()
+{
+#if defined(_WIN32)
+    file.close();
+#else
+    if (mapping != nullptr)
+    {
+        munmap(const_cast<unsigned char *>(mapping), mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+#endif
+    level_table.clear();
+}
+
+void texture_file::read_tile(int level, int tx, int ty, float *out) const
+{
+    const auto &entry = level_table[level];
+    auto offset = entry.offset + (uint64_t(ty) * entry.tiles_x + tx) * TILE_BYTES;
+#if defined(_WIN32)
+    std::lock_guard<std::mutex> guard(file_mutex);
+    file.seekg(offset);
+    file.read(reinterpret_cast<char *>(out), TILE_BYTES);
+#else
+    std::memcpy(out, mapping + offset, TILE_BYTES);
+    // The tile cache now owns the texels; drop the mapped pages so resident memory stays
+    // within the cache budget. Tiles are page aligned, so this never touches a neighbour.
+    madvise(const_cast<unsigned char *>(mapping + offset), TILE_BYTES, MADV_DONTNEED);
+#endif
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "headers.h"
+#include "texture/texture.h"
+
+// Inputs of one texture lookup.
+struct shading_point
+{
+    double u = 0;
+    double v = 0;
+    point3 p;
+    texture_footprint footprint;
+    int object_id = -1; // hit_record::object_id of the shaded surface
+};
+
+// Register file of a batch of shading points: register r holds one color per point.
+struct texture_batch
+{
+    const shading_point *points;
+    int count;
+    color *registers;
+
+    color *reg(int r) const { return registers + static_cast<size_t>(r) * count; }
+};
+
+// One step of a texture program. The kernel writes register `dst` for every point of the batch
+// from the registers `a`, `b` and `c`, the `constant` or the texture it was compiled from.
+struct texture_instruction
+{
+    using kernel_fn = void (*)(const texture_instruction &, const texture_batch &);
+
+    kernel_fn kernel = nullptr;
+    int dst = -1;
+    int a = -1;
+    int b = -1;
+    int c = -1;
+    color constant;
+    const texture *source = nullptr;
+};
+
+// A texture graph flattened into a list of register-to-register instructions, children before
+// parents. A texture shared by several parents is compiled once. Evaluation runs every
+// instruction over a whole batch of points, so the cost per point is a loop iteration instead of
+// one virtual call per graph node; the price is that both sides of a selection (the two halves of
+// a checker) are evaluated for every point.
+class texture_program
+{
+public:
+    static constexpr int BATCH = 64;
+    static constexpr int STACK_REGISTERS = 16;
+
+public:
+    texture_program() {}
+    explicit texture_program(const texture &root);
+
+    bool empty() const { return code.empty(); }
+    int size() const { return static_cast<int>(code.size()); }
+    int register_count() const { return registers; }
+
+    // Compiles `tex` (once) and returns the register that holds its value.
+    int compile(const texture &tex);
+
+    // Appends an instruction writing a new register, which is returned.
+    int emit(texture_instruction instruction);
+    int emit_constant(const color &c);
+
+    // Emits a source-less instruction computing a function of the shading points only; every
+    // texture asking for the same kernel shares one register.
+    int emit_input(texture_instruction::kernel_fn kernel);
+
+    color evaluate(const shading_point &point) const;
+    void evaluate(const shading_point *points, int count, color *out) const;
+
+    size_t heap_bytes() const { return code.capacity() * sizeof(texture_instruction); }
+
+    static void constant_kernel(const texture_instruction &instruction, const texture_batch &batch);
+    static void call_kernel(const texture_instruction &instruction, const texture_batch &batch);
+
+private:
+    std::vector<texture_instruction> code;
+    std::unordered_map<const texture *, int> compiled;
+    std::unordered_map<texture_instruction::kernel_fn, int> inputs;
+    int registers = 0;
+    int output = -1;
+
+    // Runs every instruction over `count` points with register r of point i at file[r * count + i].
+    void run(const shading_point *points, int count, color *file) const;
+
+    // Register file of the calling thread with room for at least `size` colors, grown to the
+    // largest program run on the thread so far. Kernels never evaluate other programs, so a
+    // thread needs only one.
+    static color *scratch(size_t size);
+};
+
+texture_program::texture_program(const texture &root)
+{
+    output = compile(root);
+    compiled.clear();
+    inputs.clear();
+}
+
+int texture_program::compile(const texture &tex)
+{
+    auto found = compiled.find(&tex);
+    if (found != compiled.end())
+    {
+        return found->second;
+    }
+    auto r = tex.compile(*this);
+    compiled[&tex] = r;
+    return r;
+}
+
+int texture_program::emit(texture_instruction instruction)
+{
+    instruction.dst = registers++;
+    code.push_back(instruction);
+    return instruction.dst;
+}
+
+int texture_program::emit_constant(const color &c)
+{
+    texture_instruction instruction;
+    instruction.kernel = constant_kernel;
+    instruction.constant = c;
+    return emit(instruction);
+}
+
+int texture_program::emit_input(texture_instruction::kernel_fn kernel)
+{
+    auto found = inputs.find(kernel);
+    if (found != inputs.end())
+    {
+        return found->second;
+    }
+    texture_instruction instruction;
+    instruction.kernel = kernel;
+    auto r = emit(instruction);
+    inputs[kernel] = r;
+    return r;
+}
+
+color texture_program::evaluate(const shading_point &point) const
+{
+    // Solid colors, by far the most common albedo, need no register file.
+    if (code.size() == 1 && code[0].kernel == constant_kernel)
+    {
+        return code[0].constant;
+    }
+    if (registers <= STACK_REGISTERS)
+    {
+        color file[STACK_REGISTERS];
+        run(&point, 1, file);
+        return file[output];
+    }
+    auto file = scratch(registers);
+    run(&point, 1, file);
+    return file[output];
+}
+
+void texture_program::evaluate(const shading_point *points, int count, color *out) const
+{
+    auto file = scratch(static_cast<size_t>(registers) * std::min(count, BATCH));
+    for (int first = 0; first < count; first += BATCH)
+    {
+        auto n = std::min(BATCH, count - first);
+        run(points + first, n, file);
+        std::copy(file + static_cast<size_t>(output) * n, file + static_cast<size_t>(output + 1) * n, out + first);
+    }
+}
+
+void texture_program::run(const shading_point *points, int count, color *file) const
+{
+    texture_batch batch{points, count, file};
+    for (const auto &instruction : code)
+    {
+        instruction.kernel(instruction, batch);
+    }
+}
+
+color *texture_program::scratch(size_t size)
+{
+    thread_local std::vector<color> file;
+    if (file.size() < size)
+    {
+        file.resize(size);
+    }
+    return file.data();
+}
+
+void texture_program::constant_kernel(const texture_instruction &instruction, const texture_batch &batch)
+{
+    std::fill(batch.reg(instruction.dst), batch.reg(instruction.dst) + batch.count, instruction.constant);
+}
+
+void texture_program::call_kernel(const texture_instruction &instruction, const texture_batch &batch)
+{
+    auto dst = batch.reg(instruction.dst);
+    for (int i = 0; i < batch.count; i++)
+    {
+        const auto &pt = batch.points[i];
+        dst[i] = instruction.source->filtered_value(pt.u, pt.v, pt.p, pt.footprint);
+    }
+}
+
+// Textures without a kernel of their own are called through their virtual lookup.
+int texture::compile(texture_program &program) const
+{
+    texture_instruction instruction;
+    instruction.kernel = texture_program::call_kernel;
+    instruction.source = this;
+    return program.emit(instruction);
+}
@@ -0,0 +1,232 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "texture/texture_file.h"
+
+// Fixed-budget cache of texture tiles shared by every thread and every tiled texture. Tiles
+// are faulted in from their texture_file on first use, keyed by the file's id, and the least
+// recently used tiles are evicted once the budget is reached. The cache is split into shards, each with its own lock
+// and LRU list, so concurrent lookups rarely contend.
+//
+// Each thread also keeps the last RECENT_TILES tiles it read, and hits among them take no lock
+// at all. Those tiles are shared with the shards, so a tile evicted while a thread still holds
+// it lives on until the thread moves on. The memory in use can exceed the budget by up to
+// RECENT_TILES tiles per thread, and such hits don't refresh the tile's place in the LRU list.
+class tile_cache
+{
+public:
+    static const int SHARDS = 16;
+    static const int RECENT_TILES = 16;
+    static const size_t DEFAULT_BUDGET = size_t(256) << 20;
+
+    static tile_cache &global()
+    {
+        static tile_cache cache;
+        return cache;
+    }
+
+public:
+    tile_cache(size_t budget = DEFAULT_BUDGET) : budget(budget), recent_hits(std::make_shared<std::atomic<size_t>>(0)) {}
+    tile_cache(const tile_cache &) = delete;
+    tile_cache &operator=(const tile_cache &) = delete;
+
+    void set_budget(size_t bytes) { budget = bytes; }
+    size_t budget_bytes() const { return budget; }
+    size_t used_bytes() const;
+    size_t hits() const;
+    size_t misses() const;
+
+    // Texel (x, y) of `level`, clamped to the level's edges.
+    color texel(const texture_file &file, int level, int x, int y);
+
+private:
+    using tile_texels = std::shared_ptr<const std::vector<float>>;
+
+    struct tile
+    {
+        uint64_t key;
+        tile_texels texels;
+    };
+
+    struct shard
+    {
+        mutable std::mutex lock;
+        std::list<tile> lru;
+        std::unordered_map<uint64_t, std::list<tile>::iterator> index;
+        size_t bytes = 0;
+        size_t hits = 0;
+        size_t misses = 0;
+    };
+
+    // A tile recently read by one thread. `hits` counts its lock-free hits until they are added to
+    // `counter`, the recent_hits of the cache it came from; holding the counter keeps it valid
+    // even if the cache goes away first.
+    struct recent_tile
+    {
+        uint64_t key = 0;
+        tile_texels texels;
+        std::shared_ptr<std::atomic<size_t>> counter;
+        size_t hits = 0;
+
+        void flush()
+        {
+            if (counter && hits > 0)
+            {
+                *counter += hits;
+                hits = 0;
+            }
+        }
+    };
+
+    struct recent_tiles
+    {
+        recent_tile slots[RECENT_TILES];
+
+        ~recent_tiles()
+        {
+            for (auto &slot : slots)
+            {
+                slot.flush();
+            }
+        }
+    };
+
+    shard shards[SHARDS];
+    std::atomic<size_t> budget;
+    std::shared_ptr<std::atomic<size_t>> recent_hits;
+
+    static recent_tiles &thread_tiles()
+    {
+        static thread_local recent_tiles tiles;
+        return tiles;
+    }
+
+    // Texels of a tile from its shard, read from the file on a miss.
+    tile_texels fetch(const texture_file &file, int level, int tx, int ty, uint64_t key);
+
+    // 16 bits of file id, 8 bits of level and 40 bits of tile index.
+    static uint64_t tile_key(uint32_t file_id, int level, uint64_t tile)
+    {
+        return (uint64_t(file_id) << 48) | (uint64_t(level) << 40) | tile;
+    }
+};
+
+size_t tile_cache::used_bytes() const
+{
+    size_t total = 0;
+    for (auto &s : shards)
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        total += s.bytes;
+    }
+    return total;
+}
+
+// Hits of other threads still held by their recent tiles are counted when the tiles are replaced
+// or the threads exit.
+size_t tile_cache::hits() const
+{
+    size_t total = *recent_hits;
+    for (auto &s : shards)
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        total += s.hits;
+    }
+    for (auto &slot : thread_tiles().slots)
+    {
+        total += slot.counter == recent_hits ? slot.hits : 0;
+    }
+    return total;
+}
+
+size_t tile_cache::misses() const
+{
+    size_t total = 0;
+    for (auto &s : shards)
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        total += s.misses;
+    }
+    return total;
+}
+
+color tile_cache::texel(const texture_file &file, int level, int x, int y)
+{
+    x = std::clamp(x, 0, file.width(level) - 1);
+    y = std::clamp(y, 0, file.height(level) - 1);
+    auto tx = x / texture_file::TILE_SIZE;
+    auto ty = y / texture_file::TILE_SIZE;
+    auto key = tile_key(file.id(), level, uint64_t(ty) * file.tiles_x(level) + tx);
+    auto in_tile = ((y % texture_file::TILE_SIZE) * texture_file::TILE_SIZE + x % texture_file::TILE_SIZE) * texture_file::CHANNELS;
+
+    auto &slot = thread_tiles().slots[(key ^ (key >> 37)) % RECENT_TILES];
+    if (slot.key != key || slot.counter != recent_hits)
+    {
+        slot.flush();
+        slot.texels = fetch(file, level, tx, ty, key);
+        slot.key = key;
+        slot.counter = recent_hits;
+    }
+    else
+    {
+        slot.hits++;
+    }
+    auto p = &(*slot.texels)[in_tile];
+    return color(p[0], p[1], p[2]);
+}
+
+tile_cache::tile_texels tile_cache::fetch(const texture_file &file, int level, int tx, int ty, uint64_t key)
+{
+    auto &s = shards[(key ^ (key >> 29)) % SHARDS];
+    {
+        std::lock_guard<std::mutex> guard(s.lock);
+        auto found = s.index.find(key);
+        if (found != s.index.end())
+        {
+            s.lru.splice(s.lru.begin(), s.lru, found->second);
+            s.hits++;
+            return found->second->texels;
+        }
+    }
+
+    // Fault the tile in without holding the shard lock; a racing thread may load the same
+    // tile, in which case the first copy inserted wins.
+    auto texels = std::make_shared<std::vector<float>>(texture_file::TILE_FLOATS);
+    file.read_tile(level, tx, ty, texels->data());
+
+    std::lock_guard<std::mutex> guard(s.lock);
+    s.misses++;
+    auto found = s.index.find(key);
+    if (found != s.index.end())
+    {
+        return found->second->texels;
+    }
+    auto shard_budget = budget / SHARDS;
+    while (!s.lru.empty() && s.bytes + texture_file::TILE_BYTES > shard_budget)
+    {
+        s.index.erase(s.lru.back().key);
+        s.lru.pop_back();
+        s.bytes -= texture_file::TILE_BYTES;
+    }
+    s.lru.push_front(tile{key, texels});
+    s.index[key] = s.lru.begin();
+    s.bytes += texture_file::TILE_BYTES;
+    return texels;
+}
+
+// A texture file read through the global tile cache, in the shape the mip lookups expect.
+struct cached_texture_file
+{
+    const texture_file &file;
+
+    int levels() const { return file.levels(); }
+    int width(int level) const { return file.width(level); }
+    int height(int level) const { return file.height(level); }
+    color texel(int level, int x, int y) const { return tile_cache::global().texel(file, level, x, y); }
+};
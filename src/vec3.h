@@ -6,48 +6,67 @@
 
 using std::sqrt;
 
-class vec3
+// Storage of a vec3_t. Single precision uses a 16-byte aligned 4-lane vector whose last lane is
+// kept at zero, so Eigen can use full-width SIMD loads and arithmetic.
+template <class T>
+struct vec3_storage
+{
+    using type = Eigen::Matrix<T, 3, 1>;
+    static type make(T e0, T e1, T e2) { return type(e0, e1, e2); }
+};
+
+template <>
+struct vec3_storage<float>
+{
+    using type = Eigen::Matrix<float, 4, 1>;
+    static type make(float e0, float e1, float e2) { return type(e0, e1, e2, 0.0f); }
+};
+
+template <class T>
+class vec3_t
 {
 public:
-    // double e[3];
-    Eigen::Vector3d e;
+    using scalar = T;
+    using storage = typename vec3_storage<T>::type;
+
+    storage e;
 
 public:
-    vec3() : e{0, 0, 0} {}
-    vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
-    vec3(Eigen::Vector3d e) : e(e) {}
+    vec3_t() : e(vec3_storage<T>::make(0, 0, 0)) {}
+    vec3_t(T e0, T e1, T e2) : e(vec3_storage<T>::make(e0, e1, e2)) {}
+    vec3_t(const storage &e) : e(e) {}
 
-    double x() const { return e[0]; }
-    double y() const { return e[1]; }
-    double z() const { return e[2]; }
+    T x() const { return e[0]; }
+    T y() const { return e[1]; }
+    T z() const { return e[2]; }
 
-    vec3 operator-() const { return vec3(-e); }
-    double operator[](int i) const { return e[i]; }
-    double &operator[](int i) { return e[i]; }
+    vec3_t operator-() const { return vec3_t(-e); }
+    T operator[](int i) const { return e[i]; }
+    T &operator[](int i) { return e[i]; }
 
-    vec3 &operator+=(const vec3 &v)
+    vec3_t &operator+=(const vec3_t &v)
     {
         e += v.e;
         return *this;
     }
 
-    vec3 &operator*=(const double t)
+    vec3_t &operator*=(const T t)
     {
         e *= t;
         return *this;
     }
 
-    vec3 &operator/=(const double t)
+    vec3_t &operator/=(const T t)
     {
         return *this *= (1 / t);
     }
 
-    double length() const
+    T length() const
     {
         return sqrt(length_squared());
     }
 
-    double length_squared() const
+    T length_squared() const
     {
         return e.dot(e);
     }
@@ -60,92 +79,98 @@ public:
     }
 
 public:
-    static vec3 zero() { return vec3(Eigen::Vector3d::Zero()); }
+    static vec3_t zero() { return vec3_t(); }
 
-    static vec3 identity() { return vec3(1, 1, 1); }
+    static vec3_t identity() { return vec3_t(1, 1, 1); }
 
-    inline static vec3 random()
+    inline static vec3_t random()
     {
-        return vec3(random_double(), random_double(), random_double());
+        return vec3_t(random_double(), random_double(), random_double());
     }
 
-    inline static vec3 random(double min, double max)
+    inline static vec3_t random(double min, double max)
     {
-        return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+        return vec3_t(random_double(min, max), random_double(min, max), random_double(min, max));
     }
-};
 
-using point3 = vec3;
-using color = vec3;
+    // Operators are hidden friends so double scalars convert implicitly in single precision.
 
-// Utility Functions
-inline std::ostream &operator<<(std::ostream &out, const vec3 &v)
-{
-    return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
-}
+    friend std::ostream &operator<<(std::ostream &out, const vec3_t &v)
+    {
+        return out << v.e[0] << ' ' << v.e[1] << ' ' << v.e[2];
+    }
 
-inline vec3 operator+(const vec3 &u, const vec3 &v)
-{
-    return vec3(u.e + v.e);
-}
+    friend vec3_t operator+(const vec3_t &u, const vec3_t &v)
+    {
+        return vec3_t(u.e + v.e);
+    }
 
-inline vec3 operator+(const vec3 &u, double v)
-{
-    return vec3(u.e + v);
-}
+    friend vec3_t operator+(const vec3_t &u, T v)
+    {
+        return vec3_t(u.e[0] + v, u.e[1] + v, u.e[2] + v);
+    }
 
-inline vec3 operator-(const vec3 &u, const vec3 &v)
-{
-    return vec3(u.e - v.e);
-}
+    friend vec3_t operator-(const vec3_t &u, const vec3_t &v)
+    {
+        return vec3_t(u.e - v.e);
+    }
 
-inline vec3 operator*(const vec3 &u, const vec3 &v)
-{
-    return vec3(u.e.cwiseProduct(v.e));
-}
+    friend vec3_t operator*(const vec3_t &u, const vec3_t &v)
+    {
+        return vec3_t(u.e.cwiseProduct(v.e));
+    }
 
-inline vec3 operator*(double t, const vec3 &v)
-{
-    return vec3(t * v.e);
-}
+    friend vec3_t operator*(T t, const vec3_t &v)
+    {
+        return vec3_t(t * v.e);
+    }
 
-inline vec3 operator*(const vec3 &u, double t)
-{
-    return t * u;
-}
+    friend vec3_t operator*(const vec3_t &u, T t)
+    {
+        return t * u;
+    }
 
-inline vec3 operator/(const vec3 &u, double t)
-{
-    return (1 / t) * u;
-}
+    friend vec3_t operator/(const vec3_t &u, T t)
+    {
+        return (1 / t) * u;
+    }
 
-inline double dot(const vec3 &u, const vec3 &v)
-{
-    return u.e.dot(v.e);
-}
+    friend T dot(const vec3_t &u, const vec3_t &v)
+    {
+        return u.e.dot(v.e);
+    }
 
-inline vec3 cross(const vec3 &u, const vec3 &v)
-{
-    return vec3(u.e.cross(v.e));
-}
+    friend vec3_t cross(const vec3_t &u, const vec3_t &v)
+    {
+        return vec3_t(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+                      u.e[2] * v.e[0] - u.e[0] * v.e[2],
+                      u.e[0] * v.e[1] - u.e[1] * v.e[0]);
+    }
 
-inline vec3 reflect(const vec3 &v, const vec3 &n)
-{
-    return v - 2 * dot(v, n) * n;
-}
+    friend vec3_t reflect(const vec3_t &v, const vec3_t &n)
+    {
+        return v - 2 * dot(v, n) * n;
+    }
 
-inline vec3 refract(const vec3 &uv, const vec3 &n, double etai_over_etat)
-{
-    auto cos_theta = fmin(dot(-uv, n), 1.0);
-    vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
-    vec3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
-    return r_out_perp + r_out_parallel;
-}
+    friend vec3_t refract(const vec3_t &uv, const vec3_t &n, T etai_over_etat)
+    {
+        auto cos_theta = fmin(dot(-uv, n), T(1));
+        vec3_t r_out_perp = etai_over_etat * (uv + cos_theta * n);
+        vec3_t r_out_parallel = -sqrt(fabs(1 - r_out_perp.length_squared())) * n;
+        return r_out_perp + r_out_parallel;
+    }
 
-inline vec3 unit_vector(vec3 v)
-{
-    return v / v.length();
-}
+    friend vec3_t unit_vector(vec3_t v)
+    {
+        return v / v.length();
+    }
+};
+
+using vec3 = vec3_t<real>;
+using point3 = vec3;
+using color = vec3;
+
+// Utility Functions
 
 inline vec3 random_in_unit_sphere()
 {
@@ -189,4 +214,4 @@ vec3 random_in_unit_disk()
         }
         return p;
     }
-}
\ No newline at end of file
+}
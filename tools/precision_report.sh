@@ -0,0 +1,53 @@
+#!/bin/sh
+# Renders every built-in scene with the double and the single precision build and reports
+# render time and image difference side by side.
+#
+# usage: tools/precision_report.sh [spp] [width]
+
+set -e
+
+SPP=${1:-16}
+WIDTH=${2:-400}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+SCENES="random spheres perlin_spheres earth simple_light cornell cornell_smoke final"
+
+build() {
+    cmake -S "$ROOT" -B "$ROOT/$1" -DCMAKE_BUILD_TYPE=Release $2 > /dev/null
+    cmake --build "$ROOT/$1" -j > /dev/null
+}
+
+build _build_double "-DRAY_SINGLE_PRECISION=OFF"
+build _build_float "-DRAY_SINGLE_PRECISION=ON"
+
+# Renders $2 with the build in $1 and prints the wall time in seconds.
+render() {
+    start=$(date +%s.%N)
+    (cd "$ROOT/$1" && ./Raytracer -scene "$2" -width "$WIDTH" -spp "$SPP" -image "$2.ppm" > /dev/null 2>&1)
+    end=$(date +%s.%N)
+    awk "BEGIN { print $end - $start }"
+}
+
+# Prints the channel values of a binary PPM, one per line.
+pixels() {
+    header=$(head -n 3 "$1" | wc -c)
+    tail -c +$((header + 1)) "$1" | od -An -v -tu1 | tr -s ' ' '\n' | grep -v '^$'
+}
+
+# Prints RMSE, max channel difference and PSNR of two PPM images of equal size.
+compare() {
+    pixels "$1" > "$1.txt"
+    pixels "$2" > "$2.txt"
+    awk 'FNR == 1 { file++; n = 0 }
+         { n++; if (file == 1) a[n] = $1; else { d = a[n] - $1; if (d < 0) d = -d; sum += d * d; if (d > max) max = d; count++ } }
+         END { rmse = sqrt(sum / count); psnr = rmse > 0 ? 20 * log(255 / rmse) / log(10) : 99; printf "%8.3f %4d %7.2f", rmse, max, psnr }' "$1.txt" "$2.txt"
+    rm -f "$1.txt" "$2.txt"
+}
+
+printf "%-16s %10s %10s %8s %8s %4s %7s\n" scene double_s float_s speedup rmse max psnr
+for scene in $SCENES; do
+    t_double=$(render _build_double "$scene")
+    t_float=$(render _build_float "$scene")
+    speedup=$(awk "BEGIN { printf \"%.2f\", $t_double / $t_float }")
+    diff=$(compare "$ROOT/_build_double/$scene.ppm" "$ROOT/_build_float/$scene.ppm")
+    printf "%-16s %10.2f %10.2f %8s %s\n" "$scene" "$t_double" "$t_float" "$speedup" "$diff"
+done
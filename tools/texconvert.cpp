@@ -0,0 +1,37 @@
+// Converts an image to a tiled, mipmapped texture file (.rtt). image_texture uses the
+// converted file instead of the image when it sits next to it, and then streams tiles through
+// the tile cache within the -texture_budget of the renderer.
+//
+// usage: texconvert <image> [output.rtt]
+
+#include "headers.h"
+#include <iostream>
+#include "texture/texture.h"
+#include "texture/image_texture.h"
+
+int main(int argc, const char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: texconvert <image> [output.rtt]\n";
+        return 1;
+    }
+
+    std::string input = argv[1];
+    std::string output = argc > 2 ? argv[2] : image_texture::tiled_path(input);
+
+    texture_source source;
+    auto image = image_texture::load_mipmap(input.c_str());
+    if (image.empty() || !texture_source::stat(input, source))
+    {
+        std::cerr << "ERROR: Could not load texture image file '" << input << "'.\n";
+        return 1;
+    }
+    if (!texture_file::write(output, image, source))
+    {
+        return 1;
+    }
+
+    std::cerr << input << ": " << image.width() << "x" << image.height() << ", " << image.levels() << " levels -> " << output << "\n";
+    return 0;
+}